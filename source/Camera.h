@@ -1,4 +1,5 @@
 #pragma once
+#include <array>
 #include <cassert>
 #include <SDL_keyboard.h>
 #include <SDL_mouse.h>
@@ -28,6 +29,7 @@ namespace dae
 		const float near{ 0.1f };
 		const float far{ 100.f };
 		float aspectRatio{};
+		bool isReversedZ{};
 
 		Vector3 forward{Vector3::UnitZ};
 		Vector3 up{Vector3::UnitY};
@@ -40,6 +42,10 @@ namespace dae
 		Matrix viewMatrix{};
 		Matrix ProjectionMatrix{};
 
+		//World space planes (left, right, bottom, top, near, far), normalized and facing inwards
+		//A point p is inside the frustum when dot(plane.xyz, p) + plane.w >= 0 for all of them
+		std::array<Vector4, 6> frustumPlanes{};
+
 		void Initialize(float _fovAngle = 90.f, Vector3 _origin = {0.f,0.f,0.f},float _aspectRatio = 1)
 		{
 			fovAngle = _fovAngle;
@@ -68,6 +74,7 @@ namespace dae
 
 			viewMatrix = ONB;
 			invViewMatrix = Matrix::Inverse(viewMatrix);
+			CalculateFrustumPlanes();
 
 			//ViewMatrix => Matrix::CreateLookAtLH(...) [not implemented yet]
 			//DirectX Implementation => https://learn.microsoft.com/en-us/windows/win32/direct3d9/d3dxmatrixlookatlh
@@ -77,8 +84,39 @@ namespace dae
 		{
 			//TODO W2
 
-			ProjectionMatrix = Matrix::CreatePerspectiveFovLH(fov, aspectRatio, near, far);
+			ProjectionMatrix = isReversedZ ?
+				Matrix::CreatePerspectiveFovLHReversedZ(fov, aspectRatio, near, far) :
+				Matrix::CreatePerspectiveFovLH(fov, aspectRatio, near, far);
 			//DirectX Implementation => https://learn.microsoft.com/en-us/windows/win32/direct3d9/d3dxmatrixperspectivefovlh
+			CalculateFrustumPlanes();
+		}
+
+		void CalculateFrustumPlanes()
+		{
+			//Gribb-Hartmann: clip space is p * viewProjection, so every clip coordinate is the dot product with one column
+			//Inside means -w <= x, y <= w and 0 <= z <= w, this holds for reversed Z as well
+			const Matrix viewProjection{ invViewMatrix * ProjectionMatrix };
+			Vector4 columns[4]{};
+			for (int columnIdx = 0; columnIdx < 4; ++columnIdx)
+			{
+				columns[columnIdx] = { viewProjection[0][columnIdx], viewProjection[1][columnIdx], viewProjection[2][columnIdx], viewProjection[3][columnIdx] };
+			}
+
+			frustumPlanes =
+			{
+				columns[3] + columns[0], columns[3] - columns[0],
+				columns[3] + columns[1], columns[3] - columns[1],
+				columns[2], columns[3] - columns[2]
+			};
+
+			for (Vector4& plane : frustumPlanes)
+			{
+				const float length{ Vector3{ plane.x, plane.y, plane.z }.Magnitude() };
+				if (length > 0.f)
+				{
+					plane = plane * (1.f / length);
+				}
+			}
 		}
 
 		void Update(Timer* pTimer)
@@ -1,4 +1,6 @@
 #pragma once
+#include <array>
+#include <cfloat>
 #include "Math.h"
 #include "vector"
 
@@ -49,14 +51,202 @@ namespace dae
 		TriangleStrip
 	};
 
+	enum class CullMode
+	{
+		Back,
+		Front,
+		None
+	};
+
+	struct MeshCluster
+	{
+		//Triangles [firstTriangle, firstTriangle + nrTriangles) of the mesh, degenerate strip joins included
+		uint32_t firstTriangle{};
+		uint32_t nrTriangles{};
+
+		//Object space bounding sphere
+		Vector3 center{};
+		float radius{};
+
+		//Normal cone: every face normal is within the cone around coneAxis, coneCutoff is the sine of its half angle
+		//A cutoff of 1 never culls, the cluster faces too many directions
+		Vector3 coneAxis{};
+		float coneCutoff{ 1.f };
+	};
+
+	//Lanes of the vertex transform kernel, the vertex streams are padded to a multiple of it
+	constexpr int VERTEX_STREAM_WIDTH{ 8 };
+
+	struct VertexStreams
+	{
+		//Structure of arrays copy of the vertex attributes the transform reads, see Utils::BuildVertexStreams
+		//One float per vertex in every stream, the padding at the end is zero
+		std::vector<float> positionX{};
+		std::vector<float> positionY{};
+		std::vector<float> positionZ{};
+		std::vector<float> u{};
+		std::vector<float> v{};
+		std::vector<float> normalX{};
+		std::vector<float> normalY{};
+		std::vector<float> normalZ{};
+		std::vector<float> tangentX{};
+		std::vector<float> tangentY{};
+		std::vector<float> tangentZ{};
+	};
+
 	struct Mesh
 	{
 		std::vector<Vertex> vertices{};
 		std::vector<uint32_t> indices{};
 		PrimitiveTopology primitiveTopology{ PrimitiveTopology::TriangleStrip };
+		CullMode cullMode{ CullMode::Back };
+		std::vector<MeshCluster> clusters{};
+		VertexStreams vertexStreams{};
 
+		//Object space bounds, see Utils::CalculateMeshBounds
+		Vector3 boundsMin{};
+		Vector3 boundsMax{};
+		Vector3 boundingSphereCenter{};
+		float boundingSphereRadius{};
+
+		//Simplified LODs: largest error of Utils::SimplifyMesh along the chain, in object space. Zero for the loaded mesh
+		float simplificationError{};
+
+		//Transformed vertices of the current instance batch, instance i of the batch starts at i * vertices.size()
 		std::vector<Vertex_Out> vertices_out{};
+		std::vector<Vector4> positions_out{};
 		Matrix worldMatrix{};
+
+		//Output of cluster culling, one cluster list per instance of the current batch
+		//Bit i of a vertex reference mask is set when instance i references the vertex, only those get transformed
+		std::vector<std::vector<uint32_t>> visibleClusters{};
+		std::vector<uint8_t> vertexReferenceMasks{};
+	};
+
+	struct Tile
+	{
+		//Pixel bounds of the tile, max is exclusive
+		int minX{};
+		int minY{};
+		int maxX{};
+		int maxY{};
+
+		//Triangles overlapping this tile, in submission order
+		std::vector<uint32_t> triangleIndices{};
+
+		//Set at the start of a frame, the depth and color clear is applied when the tile is first touched
+		bool isClearPending{};
+
+		//Statistics of the last frame: fragments that passed the depth test and pixels that ended up shaded
+		uint32_t nrDepthPassedFragments{};
+		uint32_t nrResolvedPixels{};
+	};
+
+	struct EdgeEquation
+	{
+		//E(x, y) = a * x + b * y + c in sub-pixel fixed point, positive inside the triangle
+		int64_t a{};
+		int64_t b{};
+		int64_t c{};
+
+		//Top-left fill rule: -1 for edges that don't own the pixel centers lying exactly on them
+		int64_t bias{};
+	};
+
+	struct RasterSetup
+	{
+		//edges[i] is the edge opposite vertex i, it evaluates to the (scaled) barycentric weight of vertex i
+		std::array<EdgeEquation, 3> edges{};
+		float invArea{};
+
+		//NDC depth is affine in screen space, the interpolated depth is sum(weight * depth)
+		std::array<float, 3> depth{};
+
+		//Depth keys of the nearest and farthest vertex, every fragment key lies in between
+		uint32_t nearestDepth{};
+		uint32_t farthestDepth{};
+
+		//Covered pixels of a footprint of at most 4x4 pixels, bit x + (y * 4) from the top left of the bounding box
+		//Zero for triangles that take the general path
+		uint16_t smallCoverageMask{};
+	};
+
+	enum class DepthFormat
+	{
+		Float32,
+		ReversedFloat32,
+		Unorm24,
+		Unorm16
+	};
+
+	enum class DepthTest
+	{
+		Less,
+		Equal
+	};
+
+	enum class BlockCoverage
+	{
+		Outside,
+		Partial,
+		Full
+	};
+
+	struct Depth24
+	{
+		//Unorm24 depth key packed in 3 bytes, so the depth buffer has no padding byte per pixel
+		Depth24() = default;
+		explicit Depth24(uint32_t key)
+		{
+			bytes[0] = uint8_t(key);
+			bytes[1] = uint8_t(key >> 8);
+			bytes[2] = uint8_t(key >> 16);
+		}
+		operator uint32_t() const { return uint32_t(bytes[0]) | (uint32_t(bytes[1]) << 8) | (uint32_t(bytes[2]) << 16); }
+
+		uint8_t bytes[3]{};
+	};
+	static_assert(sizeof(Depth24) == 3);
+
+	struct DepthBlock
+	{
+		//Nearest and farthest depth key currently stored in one block of the depth buffer
+		uint32_t minDepth{ UINT32_MAX };
+		uint32_t maxDepth{ UINT32_MAX };
+	};
+
+	//1/w, uv, normal, tangent and viewDirection, all divided by w
+	constexpr int NR_ATTRIBUTE_CHANNELS{ 12 };
+
+	struct AttributePlanes
+	{
+		//channel = origin + (weight1 * gradient1) + (weight2 * gradient2), set up once per triangle
+		//The barycentric weights are affine in screen space, so these are the screen space planes of every channel
+		std::array<float, NR_ATTRIBUTE_CHANNELS> origin{};
+		std::array<float, NR_ATTRIBUTE_CHANNELS> gradient1{};
+		std::array<float, NR_ATTRIBUTE_CHANNELS> gradient2{};
+	};
+
+	struct TriangleRecord
+	{
+		//Output of primitive assembly, everything the tiles need to rasterize and shade one triangle
+		//Screen space x and y, NDC depth and view depth w of every vertex
+		std::array<Vector4, 3> positions{};
+
+		//uv, normal, tangent and viewDirection of every vertex, not yet divided by w
+		//The attribute planes are set up from these after binning, see Renderer::m_AttributePlanes
+		std::array<std::array<float, NR_ATTRIBUTE_CHANNELS - 1>, 3> attributes{};
+	};
+	//180 bytes, the stream is written once per triangle and read by every tile it is binned to
+	static_assert(sizeof(TriangleRecord) == (3 * sizeof(Vector4)) + (3 * (NR_ATTRIBUTE_CHANNELS - 1) * sizeof(float)));
+
+	struct VisibilityEntry
+	{
+		//Triangle that won the depth test and its screen space weights, the weight of vertex 2 is the remainder
+		//UINT32_MAX marks a pixel no triangle has written since its tile was cleared
+		uint32_t triangleIdx{ UINT32_MAX };
+		float weight0{};
+		float weight1{};
 	};
 
 	struct Light
@@ -156,7 +156,19 @@ namespace dae {
 				{ 1 / (aspect * fov)					, 0					, 0																	,0 },
 				{ 0										, 1 / fov			, 0																	,0 },
 				{ 0										, 0					, zf / (zf - zn)													,1 },
-				{ 0										, 0					,-(zf * zn) / (zf * zn)												,0 }
+				{ 0										, 0					,-(zf * zn) / (zf - zn)												,0 }
+
+		};
+	}
+
+	Matrix Matrix::CreatePerspectiveFovLHReversedZ(float fov, float aspect, float zn, float zf)
+	{
+		//Same as CreatePerspectiveFovLH with near and far swapped, depth goes from 1 at zn to 0 at zf
+		return {
+				{ 1 / (aspect * fov)					, 0					, 0																	,0 },
+				{ 0										, 1 / fov			, 0																	,0 },
+				{ 0										, 0					, -zn / (zf - zn)													,1 },
+				{ 0										, 0					, (zf * zn) / (zf - zn)												,0 }
 
 		};
 	}
@@ -7,7 +7,11 @@
 #include "Math.h"
 #include "Matrix.h"
 #include "Texture.h"
+#include "ThreadPool.h"
 #include "Utils.h"
+#include <bit>
+#include <chrono>
+#include <immintrin.h>
 #include <iostream>
 
 using namespace dae;
@@ -35,7 +39,19 @@ Renderer::Renderer(SDL_Window* pWindow)
 	m_pFrontBuffer			= SDL_GetWindowSurface(pWindow);
 	m_pBackBuffer			= SDL_CreateRGBSurface(0, m_Width, m_Height, 32, 0, 0, 0, 0);
 	m_pBackBufferPixels		= (uint32_t*)m_pBackBuffer->pixels;
-	m_pDepthBufferPixels	= new float[m_Width * m_Height];
+
+	//Depth, visibility and staged color are stored tile by tile, see GetPixelIndex. Edge tiles are padded to a full tile
+	m_NrTilesX				= (m_Width + TILE_SIZE - 1) / TILE_SIZE;
+	m_NrTilesY				= (m_Height + TILE_SIZE - 1) / TILE_SIZE;
+	m_NrTiledPixels			= m_NrTilesX * m_NrTilesY * TILE_SIZE * TILE_SIZE;
+	m_pColorBuffer			= new float[3 * m_NrTiledPixels];
+	m_pDepthBufferPixels	= new uint32_t[m_NrTiledPixels];
+	m_pVisibilityBuffer		= new VisibilityEntry[m_NrTiledPixels];
+
+	//Hierarchical Z, one min/max entry per 8x8 block of the depth buffer
+	m_NrDepthBlocksX		= (m_Width + DEPTH_BLOCK_SIZE - 1) / DEPTH_BLOCK_SIZE;
+	m_NrDepthBlocksY		= (m_Height + DEPTH_BLOCK_SIZE - 1) / DEPTH_BLOCK_SIZE;
+	m_pDepthBlocks			= new DepthBlock[m_NrDepthBlocksX * m_NrDepthBlocksY];
 
 	//Initialize Camera
 	m_Camera.Initialize(60.f, { .0f,0.0f,-45.f }, m_AspectRatio);
@@ -44,17 +60,105 @@ Renderer::Renderer(SDL_Window* pWindow)
 	m_pVehicleMesh = new Mesh();
 	m_pVehicleMesh->primitiveTopology = PrimitiveTopology::TriangleList;
 	Utils::ParseOBJ("Resources/vehicle.obj", m_pVehicleMesh->vertices, m_pVehicleMesh->indices);
-	m_pVehicleMesh->vertices_out.resize(m_pVehicleMesh->vertices.size());
+	Utils::CalculateMeshBounds(*m_pVehicleMesh);
+	m_VehicleLODs.push_back(m_pVehicleMesh);
+
+	// Every LOD is simplified from the one before it, while the index buffer is still a plain triangle list
+	for (uint32_t lodIdx = 1; lodIdx < MAX_NR_LODS; ++lodIdx)
+	{
+		const Mesh* pSource{ m_VehicleLODs.back() };
+		Mesh* pLOD{ new Mesh() };
+		pLOD->primitiveTopology = PrimitiveTopology::TriangleList;
+		pLOD->vertices = pSource->vertices;
+		pLOD->indices = pSource->indices;
+
+		const size_t nrSourceTriangles{ pSource->indices.size() / 3 };
+		const float maxError{ m_pVehicleMesh->boundingSphereRadius * LOD_BASE_ERROR * float(1 << (lodIdx - 1)) };
+		pLOD->simplificationError = std::max(pSource->simplificationError, Utils::SimplifyMesh(pLOD->vertices, pLOD->indices, nrSourceTriangles / 2, maxError));
+		if (pLOD->indices.size() / 3 > nrSourceTriangles - (nrSourceTriangles / 10))
+		{
+			delete pLOD;
+			break;
+		}
+
+		Utils::RemoveUnusedVertices(pLOD->vertices, pLOD->indices);
+		Utils::CalculateMeshBounds(*pLOD);
+		m_VehicleLODs.push_back(pLOD);
+	}
 
+	for (size_t lodIdx = 0; lodIdx < m_VehicleLODs.size(); ++lodIdx)
+	{
+		Mesh* pMesh{ m_VehicleLODs[lodIdx] };
+
+		// Reorder for the post-transform cache first, the stripifier then starts its strips in that order
+		const float unoptimizedACMR{ Utils::GetACMR(pMesh->indices, VERTEX_CACHE_SIZE) };
+		Utils::OptimizeVertexCache(pMesh->indices, uint32_t(pMesh->vertices.size()), VERTEX_CACHE_SIZE);
+		std::cout << "Vehicle LOD " << lodIdx << " | Triangles: " << pMesh->indices.size() / 3 << " | Error: " << pMesh->simplificationError
+			<< " | ACMR: " << unoptimizedACMR << " -> " << Utils::GetACMR(pMesh->indices, VERTEX_CACHE_SIZE) << "\n";
+
+		// Strips only pay off when enough triangles share edges, otherwise the joins make the index stream longer
+		std::vector<uint32_t> stripIndices{};
+		Utils::StripifyTriangleList(pMesh->indices, stripIndices);
+		if (stripIndices.size() < pMesh->indices.size())
+		{
+			pMesh->indices.swap(stripIndices);
+			pMesh->primitiveTopology = PrimitiveTopology::TriangleStrip;
+		}
+		Utils::BuildMeshClusters(*pMesh, CLUSTER_SIZE);
+		Utils::BuildVertexStreams(*pMesh);
+	}
+	m_VehicleInstances.resize(NR_INSTANCES_X * NR_INSTANCES_Z);
+	m_VehicleInstanceLODs.resize(m_VehicleInstances.size());
+	m_LODInstances.resize(m_VehicleLODs.size());
+
+	//Initialize Tiles
+	m_Tiles.resize(size_t(m_NrTilesX) * m_NrTilesY);
+	for (int tileY = 0; tileY < m_NrTilesY; ++tileY)
+	{
+		for (int tileX = 0; tileX < m_NrTilesX; ++tileX)
+		{
+			Tile& tile{ m_Tiles[tileX + (tileY * m_NrTilesX)] };
+			tile.minX = tileX * TILE_SIZE;
+			tile.minY = tileY * TILE_SIZE;
+			tile.maxX = std::min(tile.minX + TILE_SIZE, m_Width);
+			tile.maxY = std::min(tile.minY + TILE_SIZE, m_Height);
+		}
+	}
+	m_pShadedPixelMask = new uint64_t[m_NrTilesX * m_Height]{};
+	// Enough for the single vehicle, instancing and LODs change the count every frame
+	// The worst case is too large to reserve up front, the streams grow until they fit the largest frame and stay there
+	m_Triangles.reserve(Utils::GetNrTriangles(*m_pVehicleMesh));
+	m_AttributePlanes.reserve(Utils::GetNrTriangles(*m_pVehicleMesh));
+
+	m_pThreadPool = new ThreadPool();
+	m_IsAVX2Supported = Utils::IsAVX2Supported();
+
+	//The back buffer format is fixed, so the packing is decided once. It has 8 bits per channel (RGB888)
+	const SDL_PixelFormat* pFormat{ m_pBackBuffer->format };
+	m_RedShift = pFormat->Rshift;
+	m_GreenShift = pFormat->Gshift;
+	m_BlueShift = pFormat->Bshift;
+	m_AlphaMask = pFormat->Amask;
+	m_RedShiftCount = _mm_cvtsi32_si128(m_RedShift);
+	m_GreenShiftCount = _mm_cvtsi32_si128(m_GreenShift);
+	m_BlueShiftCount = _mm_cvtsi32_si128(m_BlueShift);
 }
 
 Renderer::~Renderer()
 {
+	delete m_pThreadPool;
 	delete[] m_pDepthBufferPixels;
+	delete[] m_pColorBuffer;
+	delete[] m_pShadedPixelMask;
+	delete[] m_pDepthBlocks;
+	delete[] m_pVisibilityBuffer;
 	delete m_pTextureUVGrid;
 	delete m_pTextureTukTuk;
 	delete m_pTextureVehicle;
-	delete m_pVehicleMesh;
+	for (Mesh* pLOD : m_VehicleLODs)
+	{
+		delete pLOD;
+	}
 	delete m_pNormalMapVehicle;
 	delete m_pGlossMapVehicle;
 	delete m_pSpecularMapVehicle;
@@ -71,203 +175,2145 @@ void Renderer::Update(Timer* pTimer)
 	}
 }
 
-void Renderer::Render()
-{
-	//@START
-	std::fill_n(m_pDepthBufferPixels, m_Width * m_Height, FLT_MAX);
-	SDL_FillRect(m_pBackBuffer, NULL, SDL_MapRGB(m_pBackBuffer->format, 100, 100, 100));
+void Renderer::Render()
+{
+	//@START
+	// Fast clear: tiles are only flagged here, the clear itself happens the first time a tile gets touched
+	m_ClearColor = SDL_MapRGB(m_pBackBuffer->format, 100, 100, 100);
+	for (Tile& tile : m_Tiles)
+	{
+		tile.isClearPending = true;
+	}
+
+	//Lock BackBuffer
+	SDL_LockSurface(m_pBackBuffer);
+
+	//Solutions
+	//W1-W4 don't go through the tiles, they clear every tile themselves with ClearAllTiles
+	//Solution_W1();
+	//Solution_W2_W3();
+	//Solution_W4();
+	Solution_W5();
+	
+	// Tiles no triangle reached still need the clear color, their depth is never read this frame
+	for (Tile& tile : m_Tiles)
+	{
+		if (tile.isClearPending)
+		{
+			ClearTileColor(tile);
+		}
+	}
+
+	//@END
+	//Update SDL Surface
+	SDL_UnlockSurface(m_pBackBuffer);
+	SDL_BlitSurface(m_pBackBuffer, 0, m_pFrontBuffer, 0);
+	SDL_UpdateWindowSurface(m_pWindow);
+}
+
+void Renderer::Solution_W5()
+{
+	m_pVehicleMesh->worldMatrix = Matrix::CreateRotationY(m_VehicleYaw);
+
+	for (Tile& tile : m_Tiles)
+	{
+		tile.nrDepthPassedFragments = 0;
+		tile.nrResolvedPixels = 0;
+	}
+	m_Triangles.clear();
+	++m_NrStatisticsFrames;
+
+	const Matrix* pWorldMatrices{ &m_pVehicleMesh->worldMatrix };
+	uint32_t* pInstanceLODs{ &m_VehicleLOD };
+	uint32_t nrInstances{ 1 };
+	if (m_IsInstancingEnabled)
+	{
+		// A grid of smaller copies, wider and deeper than the view so instance culling has work to do
+		const Matrix instanceScale{ Matrix::CreateScale(INSTANCE_SCALE, INSTANCE_SCALE, INSTANCE_SCALE) };
+		for (int instanceZ = 0; instanceZ < NR_INSTANCES_Z; ++instanceZ)
+		{
+			for (int instanceX = 0; instanceX < NR_INSTANCES_X; ++instanceX)
+			{
+				const int instanceIdx{ instanceX + (instanceZ * NR_INSTANCES_X) };
+				const Vector3 translation{ (instanceX - (NR_INSTANCES_X - 1) * 0.5f) * INSTANCE_SPACING, 0.f, (instanceZ - 1.5f) * INSTANCE_SPACING };
+				m_VehicleInstances[instanceIdx] = instanceScale * Matrix::CreateRotationY(m_VehicleYaw + instanceIdx * 0.5f) * Matrix::CreateTranslation(translation);
+			}
+		}
+
+		pWorldMatrices = m_VehicleInstances.data();
+		pInstanceLODs = m_VehicleInstanceLODs.data();
+		nrInstances = uint32_t(m_VehicleInstances.size());
+	}
+
+	SelectLODs(m_VehicleLODs, pWorldMatrices, pInstanceLODs, nrInstances);
+
+	// Depth Pre-Pass
+	// Every LOD lays down its depth before the first color triangle, the color pass then only shades the nearest surface
+	if (m_IsDepthPrePassEnabled)
+	{
+		for (size_t lodIdx = 0; lodIdx < m_VehicleLODs.size(); ++lodIdx)
+		{
+			if (!m_LODInstances[lodIdx].empty())
+			{
+				RenderDepthOnly(m_VehicleLODs[lodIdx], m_LODInstances[lodIdx].data(), uint32_t(m_LODInstances[lodIdx].size()));
+			}
+		}
+	}
+
+	for (size_t lodIdx = 0; lodIdx < m_VehicleLODs.size(); ++lodIdx)
+	{
+		if (!m_LODInstances[lodIdx].empty())
+		{
+			DrawMeshInstanced(m_VehicleLODs[lodIdx], m_LODInstances[lodIdx].data(), uint32_t(m_LODInstances[lodIdx].size()));
+		}
+	}
+
+	// Binning Stage
+	// Tiles render their triangles in binning order, so sorting the binning order sorts every tile
+	// The bins are reset here, the depth pre-pass uses them for its own triangles
+	for (Tile& tile : m_Tiles)
+	{
+		tile.triangleIndices.clear();
+	}
+
+	const auto binTriangle{ [this](uint32_t triangleIdx)
+		{
+			const std::array<Vector4, 3>& positions{ m_Triangles[triangleIdx].positions };
+			BinTriangle(triangleIdx, positions[0].GetXY(), positions[1].GetXY(), positions[2].GetXY());
+		} };
+
+	if (m_IsDepthSortEnabled)
+	{
+		const auto sortStart{ std::chrono::high_resolution_clock::now() };
+		SortTrianglesFrontToBack();
+		m_DepthSortTime += std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - sortStart).count();
+
+		for (uint32_t triangleIdx : m_DepthSortOrder)
+		{
+			binTriangle(triangleIdx);
+		}
+	}
+	else
+	{
+		for (uint32_t triangleIdx = 0; triangleIdx < uint32_t(m_Triangles.size()); ++triangleIdx)
+		{
+			binTriangle(triangleIdx);
+		}
+	}
+
+	// Attribute Setup Stage
+	// Triangles that can't produce a fragment anymore were only needed for depth and get no planes
+	const uint32_t nrTriangles{ uint32_t(m_Triangles.size()) };
+	const uint32_t nrSetupBatches{ (nrTriangles + ATTRIBUTE_SETUP_BATCH_SIZE - 1) / ATTRIBUTE_SETUP_BATCH_SIZE };
+	m_AttributePlanes.resize(nrTriangles);
+	m_AttributeSetupCounts.assign(nrSetupBatches, 0);
+	m_pThreadPool->ParallelFor(nrSetupBatches, [this, nrTriangles](uint32_t batchIdx)
+		{
+			const uint32_t batchEnd{ std::min((batchIdx + 1) * ATTRIBUTE_SETUP_BATCH_SIZE, nrTriangles) };
+			for (uint32_t triangleIdx = batchIdx * ATTRIBUTE_SETUP_BATCH_SIZE; triangleIdx < batchEnd; ++triangleIdx)
+			{
+				if (IsTriangleShaded(m_Triangles[triangleIdx]))
+				{
+					SetupAttributePlanes(m_Triangles[triangleIdx], m_AttributePlanes[triangleIdx]);
+					++m_AttributeSetupCounts[batchIdx];
+				}
+			}
+		});
+
+	// Rasterization Stage
+	// Every tile is owned by exactly one thread, so the buffers can be written without locks
+	m_pThreadPool->ParallelFor(uint32_t(m_Tiles.size()), [this](uint32_t tileIdx)
+		{
+			Tile& tile{ m_Tiles[tileIdx] };
+			if (tile.triangleIndices.empty() && tile.isClearPending)
+			{
+				return;
+			}
+
+			ClearTile(tile);
+			RenderTile(tile);
+		});
+
+	for (const Tile& tile : m_Tiles)
+	{
+		m_NrDepthPassedFragments += tile.nrDepthPassedFragments;
+		m_NrResolvedPixels += tile.nrResolvedPixels;
+	}
+
+	m_NrTriangleRecords += nrTriangles;
+	for (uint32_t nrSetups : m_AttributeSetupCounts)
+	{
+		m_NrAttributePlaneSetups += nrSetups;
+	}
+}
+
+void Renderer::SelectLODs(const std::vector<Mesh*>& lods, const Matrix* pWorldMatrices, uint32_t* pInstanceLODs, uint32_t nrInstances)
+{
+	// LOD Selection Stage
+	// pInstanceLODs holds the LOD of every instance in the last frame, the hysteresis needs it
+	for (std::vector<Matrix>& lodInstances : m_LODInstances)
+	{
+		lodInstances.clear();
+	}
+
+	for (uint32_t instanceIdx = 0; instanceIdx < nrInstances; ++instanceIdx)
+	{
+		uint32_t& lodIdx{ pInstanceLODs[instanceIdx] };
+		lodIdx = m_IsLODEnabled ? SelectLOD(lods, pWorldMatrices[instanceIdx], lodIdx) : 0;
+		m_LODInstances[lodIdx].push_back(pWorldMatrices[instanceIdx]);
+		++m_NrLODInstances[lodIdx];
+	}
+}
+
+uint32_t Renderer::SelectLOD(const std::vector<Mesh*>& lods, const Matrix& worldMatrix, uint32_t currentLOD) const
+{
+	// Projected radius of the bounding sphere in pixels: radius * (height / 2) / (tan(fov / 2) * distance)
+	const Mesh* pMesh{ lods[0] };
+	const float scale{ std::max({ worldMatrix.GetAxisX().Magnitude(), worldMatrix.GetAxisY().Magnitude(), worldMatrix.GetAxisZ().Magnitude() }) };
+	const float radius{ pMesh->boundingSphereRadius * scale };
+	const float distance{ (worldMatrix.TransformPoint(pMesh->boundingSphereCenter) - m_Camera.origin).Magnitude() };
+	if (distance <= radius)
+	{
+		return 0;
+	}
+	const float projectedRadius{ (radius * m_Height * 0.5f) / (m_Camera.fov * distance) };
+
+	// The coarsest LOD whose error stays below LOD_PIXEL_ERROR on screen, the errors are relative to the sphere radius
+	// Going coarser than the current LOD needs to clear the threshold by the hysteresis, staying on it may exceed it as much
+	for (uint32_t lodIdx = uint32_t(lods.size()) - 1; lodIdx > 0; --lodIdx)
+	{
+		const float threshold{ LOD_PIXEL_ERROR * (lodIdx > currentLOD ? 1.f - m_LODHysteresis : 1.f + m_LODHysteresis) };
+		if ((lods[lodIdx]->simplificationError / pMesh->boundingSphereRadius) * projectedRadius <= threshold)
+		{
+			return lodIdx;
+		}
+	}
+	return 0;
+}
+
+void Renderer::DrawMeshInstanced(Mesh* pMesh, const Matrix* pWorldMatrices, uint32_t nrInstances)
+{
+	// Instance Culling Stage
+	// Only the bounding sphere is tested, an instance outside the frustum never touches a vertex
+	m_VisibleInstances.clear();
+	for (uint32_t instanceIdx = 0; instanceIdx < nrInstances; ++instanceIdx)
+	{
+		if (IsMeshInFrustum(pMesh, pWorldMatrices[instanceIdx]))
+		{
+			m_VisibleInstances.push_back(instanceIdx);
+		}
+	}
+	m_NrInstances += nrInstances;
+	m_NrVisibleInstances += m_VisibleInstances.size();
+
+	// The transform stages walk the vertices once per batch and write every instance of it, so each vertex is read while hot
+	for (size_t batchStart = 0; batchStart < m_VisibleInstances.size(); batchStart += INSTANCE_BATCH_SIZE)
+	{
+		const uint32_t nrBatchInstances{ uint32_t(std::min(size_t(INSTANCE_BATCH_SIZE), m_VisibleInstances.size() - batchStart)) };
+		std::array<Matrix, INSTANCE_BATCH_SIZE> worldMatrices{};
+		for (uint32_t batchInstanceIdx = 0; batchInstanceIdx < nrBatchInstances; ++batchInstanceIdx)
+		{
+			worldMatrices[batchInstanceIdx] = pWorldMatrices[m_VisibleInstances[batchStart + batchInstanceIdx]];
+		}
+
+		//Cluster Culling Stage
+		const uint32_t nrReferencedVertices{ CullMeshBatch(pMesh, worldMatrices.data(), nrBatchInstances) };
+		for (uint32_t batchInstanceIdx = 0; batchInstanceIdx < nrBatchInstances; ++batchInstanceIdx)
+		{
+			m_NrVisibleClusters += pMesh->visibleClusters[batchInstanceIdx].size();
+			m_NrClusters += pMesh->clusters.size();
+		}
+
+		//Projection Stage
+		if (m_IsOnDemandTransformEnabled)
+		{
+			// Only positions up front, the attributes are transformed when a triangle first references the vertex
+			VertexTransformationDepthOnly(pMesh, worldMatrices.data(), nrBatchInstances);
+		}
+		else
+		{
+			VertexTransformationMatrix(pMesh, worldMatrices.data(), nrBatchInstances);
+			m_NrVertexTransforms += nrReferencedVertices;
+		}
+
+		for (uint32_t batchInstanceIdx = 0; batchInstanceIdx < nrBatchInstances; ++batchInstanceIdx)
+		{
+			AssembleMeshInstance(pMesh, worldMatrices[batchInstanceIdx], batchInstanceIdx);
+		}
+	}
+}
+
+void Renderer::AssembleMeshInstance(const Mesh* pMesh, const Matrix& worldMatrix, uint32_t batchInstanceIdx)
+{
+	const size_t vertexOffset{ batchInstanceIdx * pMesh->vertices.size() };
+	const Vertex_Out* pVertices{ pMesh->vertices_out.data() + vertexOffset };
+	const Vector4* pPositions{ pMesh->positions_out.data() + vertexOffset };
+
+	// The cache holds transformed vertices of one instance
+	if (m_IsOnDemandTransformEnabled)
+	{
+		m_VertexCacheTags.fill(UINT32_MAX);
+	}
+
+	for (uint32_t clusterIdx : pMesh->visibleClusters[batchInstanceIdx])
+	{
+		const MeshCluster& cluster{ pMesh->clusters[clusterIdx] };
+		for (size_t triangleIdx = cluster.firstTriangle; triangleIdx < size_t(cluster.firstTriangle) + cluster.nrTriangles; ++triangleIdx)
+		{
+			// Primitive Assembly Stage
+			// The vertices are read in place, only the compact TriangleRecord gets written
+			std::array<uint32_t, 3> indices{};
+			if (!Utils::GetTriangleIndices(*pMesh, triangleIdx, indices))
+			{
+				continue;
+			}
+			++m_NrAssembledTriangles;
+
+			std::array<const Vector4*, 3> clipPositions{};
+			for (int vertexIdx = 0; vertexIdx < 3; ++vertexIdx)
+			{
+				clipPositions[vertexIdx] = m_IsOnDemandTransformEnabled ? &pPositions[indices[vertexIdx]] : &pVertices[indices[vertexIdx]].position;
+			}
+
+			// Optimisation Stage
+			const uint16_t clipCodes[3]{ GetClipCode(*clipPositions[0]), GetClipCode(*clipPositions[1]), GetClipCode(*clipPositions[2]) };
+			if (IsFrustumCullingRequired(clipCodes))
+			{
+				continue;
+			}
+
+			const uint16_t clipPlanes{ uint16_t((clipCodes[0] | clipCodes[1] | clipCodes[2]) & CLIP_MASK) };
+
+			// Clip Space -> Screen Space Coordinates
+			// Unclipped triangles are projected and culled once here, back faces never get their attributes transformed
+			std::array<Vector4, 3> positions{};
+			if (clipPlanes == 0)
+			{
+				positions = { *clipPositions[0], *clipPositions[1], *clipPositions[2] };
+				for (Vector4& position : positions)
+				{
+					ProjectToScreen(position);
+				}
+
+				if (IsFaceCullingRequired(positions[0].GetXY(), positions[1].GetXY(), positions[2].GetXY(), pMesh->cullMode))
+				{
+					continue;
+				}
+			}
+
+			// Vertex Fetch Stage
+			std::array<const Vertex_Out*, 3> vertices{};
+			if (m_IsOnDemandTransformEnabled)
+			{
+				FetchTriangleVertices(pMesh, worldMatrix, pPositions, indices, vertices);
+			}
+			else
+			{
+				vertices = { &pVertices[indices[0]], &pVertices[indices[1]], &pVertices[indices[2]] };
+			}
+
+			const Vertex_Out& v0{ *vertices[0] };
+			const Vertex_Out& v1{ *vertices[1] };
+			const Vertex_Out& v2{ *vertices[2] };
+
+			// Clipping Stage
+			// Only triangles crossing the depth range or leaving the guard band pay for clipping, the rest is clamped by the bounding box
+			if (clipPlanes == 0)
+			{
+				AddTriangleRecord(positions, v0, v1, v2);
+				continue;
+			}
+
+			ClipTriangle(std::array<Vertex_Out, 3>{ v0, v1, v2 }, clipPlanes, m_ClipVertices, m_ClipScratchVertices);
+			for (size_t vertexIdx = 2; vertexIdx < m_ClipVertices.size(); ++vertexIdx)
+			{
+				AssembleTriangle_W5(m_ClipVertices[0], m_ClipVertices[vertexIdx - 1], m_ClipVertices[vertexIdx], pMesh->cullMode);
+			}
+		}
+	}
+}
+
+void Renderer::AssembleTriangle_W5(const Vertex_Out& v0, const Vertex_Out& v1, const Vertex_Out& v2, CullMode cullMode)
+{
+	// Clip Space -> Screen Space Coordinates
+	std::array<Vector4, 3> positions{ v0.position, v1.position, v2.position };
+	for (Vector4& position : positions)
+	{
+		ProjectToScreen(position);
+	}
+
+	// Culling Stage
+	if (IsFaceCullingRequired(positions[0].GetXY(), positions[1].GetXY(), positions[2].GetXY(), cullMode))
+	{
+		return;
+	}
+
+	AddTriangleRecord(positions, v0, v1, v2);
+}
+
+void Renderer::AddTriangleRecord(const std::array<Vector4, 3>& positions, const Vertex_Out& v0, const Vertex_Out& v1, const Vertex_Out& v2)
+{
+	// Triangles are binned and get their attribute planes once the whole frame is assembled, see Solution_W5
+	TriangleRecord& triangle{ m_Triangles.emplace_back() };
+	triangle.positions = positions;
+	const Vertex_Out* vertices[3]{ &v0, &v1, &v2 };
+	for (int vertexIdx = 0; vertexIdx < 3; ++vertexIdx)
+	{
+		const Vertex_Out& vertex{ *vertices[vertexIdx] };
+		triangle.attributes[vertexIdx] =
+		{
+			vertex.uv.x, vertex.uv.y,
+			vertex.normal.x, vertex.normal.y, vertex.normal.z,
+			vertex.tangent.x, vertex.tangent.y, vertex.tangent.z,
+			vertex.viewDirection.x, vertex.viewDirection.y, vertex.viewDirection.z
+		};
+	}
+}
+
+bool Renderer::IsMeshInFrustum(const Mesh* pMesh, const Matrix& worldMatrix) const
+{
+	// The bounding sphere moves with the world matrix, its radius grows with the largest axis scale
+	const Vector3 center{ worldMatrix.TransformPoint(pMesh->boundingSphereCenter) };
+	const float scale{ std::max({ worldMatrix.GetAxisX().Magnitude(), worldMatrix.GetAxisY().Magnitude(), worldMatrix.GetAxisZ().Magnitude() }) };
+	const float radius{ pMesh->boundingSphereRadius * scale };
+
+	for (const Vector4& plane : m_Camera.frustumPlanes)
+	{
+		if (Vector3::Dot({ plane.x, plane.y, plane.z }, center) + plane.w < -radius)
+		{
+			return false;
+		}
+	}
+
+	// The box is tighter but costs the planes in object space, so it only runs for instances the sphere kept
+	// Per plane only the corner furthest along the normal is tested, if that one is outside the whole box is
+	for (const Vector4& worldPlane : m_Camera.frustumPlanes)
+	{
+		Vector4 plane{};
+		for (int rowIdx = 0; rowIdx < 4; ++rowIdx)
+		{
+			plane[rowIdx] = Vector4::Dot(worldMatrix[rowIdx], worldPlane);
+		}
+
+		const Vector3 corner
+		{
+			plane.x >= 0.f ? pMesh->boundsMax.x : pMesh->boundsMin.x,
+			plane.y >= 0.f ? pMesh->boundsMax.y : pMesh->boundsMin.y,
+			plane.z >= 0.f ? pMesh->boundsMax.z : pMesh->boundsMin.z
+		};
+		if (Vector3::Dot({ plane.x, plane.y, plane.z }, corner) + plane.w < 0.f)
+		{
+			return false;
+		}
+	}
+	return true;
+}
+
+uint32_t Renderer::CullClusters(Mesh* pMesh, const Matrix& worldMatrix, uint32_t batchInstanceIdx)
+{
+	// The camera planes are brought to object space: p_world = p_object * world, so plane_object = world * plane_world
+	Vector4 planes[6]{};
+	for (size_t planeIdx = 0; planeIdx < m_Camera.frustumPlanes.size(); ++planeIdx)
+	{
+		const Vector4& plane{ m_Camera.frustumPlanes[planeIdx] };
+		for (int rowIdx = 0; rowIdx < 4; ++rowIdx)
+		{
+			planes[planeIdx][rowIdx] = Vector4::Dot(worldMatrix[rowIdx], plane);
+		}
+	}
+
+	// The normal cones are in object space too
+	const Vector3 cameraPosition{ Matrix::Inverse(worldMatrix).TransformPoint(m_Camera.origin) };
+
+	std::vector<uint32_t>& visibleClusters{ pMesh->visibleClusters[batchInstanceIdx] };
+	visibleClusters.clear();
+	const uint8_t instanceBit{ uint8_t(1 << batchInstanceIdx) };
+	uint32_t nrReferencedVertices{};
+
+	for (uint32_t clusterIdx = 0; clusterIdx < uint32_t(pMesh->clusters.size()); ++clusterIdx)
+	{
+		const MeshCluster& cluster{ pMesh->clusters[clusterIdx] };
+
+		// Entirely outside one plane means every triangle of the cluster would fail IsFrustumCullingRequired
+		bool isOutside{};
+		for (const Vector4& plane : planes)
+		{
+			const Vector3 normal{ plane.x, plane.y, plane.z };
+			if (Vector3::Dot(normal, cluster.center) + plane.w < -cluster.radius * normal.Magnitude())
+			{
+				isOutside = true;
+				break;
+			}
+		}
+
+		if (isOutside || IsClusterFacingAway(cluster, cameraPosition, pMesh->cullMode))
+		{
+			continue;
+		}
+
+		visibleClusters.push_back(clusterIdx);
+		for (size_t triangleIdx = cluster.firstTriangle; triangleIdx < size_t(cluster.firstTriangle) + cluster.nrTriangles; ++triangleIdx)
+		{
+			std::array<uint32_t, 3> indices{};
+			if (!Utils::GetTriangleIndices(*pMesh, triangleIdx, indices))
+			{
+				continue;
+			}
+
+			for (uint32_t index : indices)
+			{
+				nrReferencedVertices += (pMesh->vertexReferenceMasks[index] & instanceBit) == 0;
+				pMesh->vertexReferenceMasks[index] |= instanceBit;
+			}
+		}
+	}
+
+	return nrReferencedVertices;
+}
+
+bool Renderer::IsClusterFacingAway(const MeshCluster& cluster, const Vector3& cameraPosition, CullMode cullMode) const
+{
+	if (cullMode == CullMode::None)
+	{
+		return false;
+	}
+
+	// Every point p of the bounding sphere has to see every face from behind: the angle between p - camera and the cone axis
+	// has to stay below 90 degrees minus the half angle of the cone, which is checked against the whole sphere at once
+	const Vector3 coneAxis{ cullMode == CullMode::Back ? cluster.coneAxis : -cluster.coneAxis };
+	const Vector3 toCenter{ cluster.center - cameraPosition };
+	return Vector3::Dot(toCenter, coneAxis) - cluster.radius > cluster.coneCutoff * (toCenter.Magnitude() + cluster.radius);
+}
+
+void Renderer::FetchTriangleVertices(const Mesh* pMesh, const Matrix& worldMatrix, const Vector4* pPositions, const std::array<uint32_t, 3>& indices, std::array<const Vertex_Out*, 3>& vertices)
+{
+	// Look up all three first, a miss must not evict a slot another vertex of this triangle still points to
+	uint32_t slots[3]{ UINT32_MAX, UINT32_MAX, UINT32_MAX };
+	for (int vertexIdx = 0; vertexIdx < 3; ++vertexIdx)
+	{
+		for (uint32_t slot = 0; slot < VERTEX_CACHE_SIZE; ++slot)
+		{
+			if (m_VertexCacheTags[slot] == indices[vertexIdx])
+			{
+				slots[vertexIdx] = slot;
+				break;
+			}
+		}
+	}
+
+	for (int vertexIdx = 0; vertexIdx < 3; ++vertexIdx)
+	{
+		if (slots[vertexIdx] == UINT32_MAX)
+		{
+			uint32_t slot{};
+			do
+			{
+				slot = m_NextVertexCacheSlot;
+				m_NextVertexCacheSlot = (m_NextVertexCacheSlot + 1) % VERTEX_CACHE_SIZE;
+			} while (slot == slots[0] || slot == slots[1] || slot == slots[2]);
+
+			m_VertexCacheTags[slot] = indices[vertexIdx];
+			TransformVertex(pMesh, worldMatrix, indices[vertexIdx], pPositions[indices[vertexIdx]], m_VertexCache[slot]);
+			++m_NrVertexTransforms;
+			slots[vertexIdx] = slot;
+		}
+
+		vertices[vertexIdx] = &m_VertexCache[slots[vertexIdx]];
+	}
+}
+
+void Renderer::TransformVertex(const Mesh* pMesh, const Matrix& worldMatrix, uint32_t vertexIdx, const Vector4& position, Vertex_Out& vertex_out) const
+{
+	// Same operations as VertexTransformationMatrix, the position comes from VertexTransformationDepthOnly
+	const Vertex& vertex{ pMesh->vertices[vertexIdx] };
+	vertex_out.position = position;
+	vertex_out.uv = vertex.uv;
+
+	vertex_out.normal = worldMatrix.TransformVector(vertex.normal);
+	vertex_out.tangent = worldMatrix.TransformVector(vertex.tangent);
+	vertex_out.normal.Normalize();
+	vertex_out.tangent.Normalize();
+
+	vertex_out.viewDirection = worldMatrix.TransformPoint(vertex.position) - m_Camera.origin;
+}
+
+void Renderer::SortTrianglesFrontToBack()
+{
+	const uint32_t nrTriangles{ uint32_t(m_Triangles.size()) };
+	m_DepthSortKeys.resize(nrTriangles);
+	m_DepthSortOrder.resize(nrTriangles);
+	m_DepthSortScratch.resize(nrTriangles);
+
+	// w is the view depth and positive after clipping, so its float bits grow with distance
+	for (uint32_t triangleIdx = 0; triangleIdx < nrTriangles; ++triangleIdx)
+	{
+		const std::array<Vector4, 3>& positions{ m_Triangles[triangleIdx].positions };
+		const float nearestDepth{ std::min(std::min(positions[0].w, positions[1].w), positions[2].w) };
+		m_DepthSortKeys[triangleIdx] = uint16_t(std::bit_cast<uint32_t>(nearestDepth) >> 16);
+		m_DepthSortOrder[triangleIdx] = triangleIdx;
+	}
+
+	// LSD radix sort, every pass is stable so triangles with equal keys keep their submission order
+	for (int shift{ 0 }; shift < 16; shift += 8)
+	{
+		uint32_t offsets[256]{};
+		for (uint16_t key : m_DepthSortKeys)
+		{
+			++offsets[(key >> shift) & 0xFF];
+		}
+
+		uint32_t offset{};
+		for (uint32_t& bucketOffset : offsets)
+		{
+			const uint32_t bucketSize{ bucketOffset };
+			bucketOffset = offset;
+			offset += bucketSize;
+		}
+
+		for (uint32_t triangleIdx : m_DepthSortOrder)
+		{
+			m_DepthSortScratch[offsets[(m_DepthSortKeys[triangleIdx] >> shift) & 0xFF]++] = triangleIdx;
+		}
+		m_DepthSortOrder.swap(m_DepthSortScratch);
+	}
+}
+
+void Renderer::AssembleTriangleDepth(std::array<Vector4, 3> triangle, CullMode cullMode)
+{
+	// Same projection and culling as the color path, so an equal depth test matches bit for bit
+	for (Vector4& position : triangle)
+	{
+		ProjectToScreen(position);
+	}
+
+	if (IsFaceCullingRequired(triangle[0].GetXY(), triangle[1].GetXY(), triangle[2].GetXY(), cullMode))
+	{
+		return;
+	}
+
+	m_DepthTrianglesScreenSpace.push_back({ triangle[0].GetXYZ(), triangle[1].GetXYZ(), triangle[2].GetXYZ() });
+	BinTriangle(uint32_t(m_DepthTrianglesScreenSpace.size()) - 1, triangle[0].GetXY(), triangle[1].GetXY(), triangle[2].GetXY());
+}
+
+uint32_t Renderer::CullMeshBatch(Mesh* pMesh, const Matrix* pWorldMatrices, uint32_t nrInstances)
+{
+	// Room for one full batch, instance i of a batch owns the vertices from i * vertices.size() on
+	const size_t nrVertices{ pMesh->vertices.size() };
+	if (pMesh->vertices_out.size() < nrVertices * INSTANCE_BATCH_SIZE)
+	{
+		pMesh->vertices_out.resize(nrVertices * INSTANCE_BATCH_SIZE);
+		pMesh->positions_out.resize(nrVertices * INSTANCE_BATCH_SIZE);
+	}
+	pMesh->visibleClusters.resize(INSTANCE_BATCH_SIZE);
+	pMesh->vertexReferenceMasks.assign(nrVertices, uint8_t(0));
+
+	uint32_t nrReferencedVertices{};
+	for (uint32_t batchInstanceIdx = 0; batchInstanceIdx < nrInstances; ++batchInstanceIdx)
+	{
+		nrReferencedVertices += CullClusters(pMesh, pWorldMatrices[batchInstanceIdx], batchInstanceIdx);
+	}
+	return nrReferencedVertices;
+}
+
+void Renderer::RenderDepthOnly(Mesh* pMesh, const Matrix* pWorldMatrices, uint32_t nrInstances)
+{
+	// Culls instances and clusters itself, the color draw of the same mesh culls them again with its own batches
+	m_VisibleInstances.clear();
+	for (uint32_t instanceIdx = 0; instanceIdx < nrInstances; ++instanceIdx)
+	{
+		if (IsMeshInFrustum(pMesh, pWorldMatrices[instanceIdx]))
+		{
+			m_VisibleInstances.push_back(instanceIdx);
+		}
+	}
+
+	for (size_t batchStart = 0; batchStart < m_VisibleInstances.size(); batchStart += INSTANCE_BATCH_SIZE)
+	{
+		const uint32_t nrBatchInstances{ uint32_t(std::min(size_t(INSTANCE_BATCH_SIZE), m_VisibleInstances.size() - batchStart)) };
+		std::array<Matrix, INSTANCE_BATCH_SIZE> worldMatrices{};
+		for (uint32_t batchInstanceIdx = 0; batchInstanceIdx < nrBatchInstances; ++batchInstanceIdx)
+		{
+			worldMatrices[batchInstanceIdx] = pWorldMatrices[m_VisibleInstances[batchStart + batchInstanceIdx]];
+		}
+
+		CullMeshBatch(pMesh, worldMatrices.data(), nrBatchInstances);
+		RenderDepthOnlyBatch(pMesh, worldMatrices.data(), nrBatchInstances);
+	}
+}
+
+void Renderer::RenderDepthOnlyBatch(Mesh* pMesh, const Matrix* pWorldMatrices, uint32_t nrInstances)
+{
+	// Draws the batch CullMeshBatch just culled
+	// Positions only: no Vertex_Out, no attribute interpolation and no color writes
+	VertexTransformationDepthOnly(pMesh, pWorldMatrices, nrInstances);
+
+	for (Tile& tile : m_Tiles)
+	{
+		tile.triangleIndices.clear();
+	}
+	m_DepthTrianglesScreenSpace.clear();
+
+	for (uint32_t batchInstanceIdx = 0; batchInstanceIdx < nrInstances; ++batchInstanceIdx)
+	{
+		const Vector4* pPositions{ pMesh->positions_out.data() + (batchInstanceIdx * pMesh->vertices.size()) };
+		for (uint32_t clusterIdx : pMesh->visibleClusters[batchInstanceIdx])
+		{
+			const MeshCluster& cluster{ pMesh->clusters[clusterIdx] };
+			for (size_t triangleIdx = cluster.firstTriangle; triangleIdx < size_t(cluster.firstTriangle) + cluster.nrTriangles; ++triangleIdx)
+			{
+				std::array<uint32_t, 3> indices{};
+				if (!Utils::GetTriangleIndices(*pMesh, triangleIdx, indices))
+				{
+					continue;
+				}
+
+				const std::array<Vector4, 3> triangle{ pPositions[indices[0]], pPositions[indices[1]], pPositions[indices[2]] };
+
+				const uint16_t clipCodes[3]{ GetClipCode(triangle[0]), GetClipCode(triangle[1]), GetClipCode(triangle[2]) };
+				if (IsFrustumCullingRequired(clipCodes))
+				{
+					continue;
+				}
+
+				const uint16_t clipPlanes{ uint16_t((clipCodes[0] | clipCodes[1] | clipCodes[2]) & CLIP_MASK) };
+				if (clipPlanes == 0)
+				{
+					AssembleTriangleDepth(triangle, pMesh->cullMode);
+					continue;
+				}
+
+				ClipTriangle(triangle, clipPlanes, m_ClipPositions, m_ClipScratchPositions);
+				for (size_t vertexIdx = 2; vertexIdx < m_ClipPositions.size(); ++vertexIdx)
+				{
+					AssembleTriangleDepth({ m_ClipPositions[0], m_ClipPositions[vertexIdx - 1], m_ClipPositions[vertexIdx] }, pMesh->cullMode);
+				}
+			}
+		}
+	}
+
+	m_pThreadPool->ParallelFor(uint32_t(m_Tiles.size()), [this](uint32_t tileIdx)
+		{
+			Tile& tile{ m_Tiles[tileIdx] };
+			if (tile.triangleIndices.empty())
+			{
+				return;
+			}
+
+			ClearTile(tile);
+			for (uint32_t triangleIdx : tile.triangleIndices)
+			{
+				RenderTriangleDepth(m_DepthTrianglesScreenSpace[triangleIdx], tile);
+			}
+		});
+}
+
+void Renderer::BinTriangle(uint32_t triangleIdx, const Vector2& v0, const Vector2& v1, const Vector2& v2)
+{
+	Vector2 topLeft{};
+	Vector2 botRight{};
+	FindBoundingBoxCorners(topLeft, botRight, v0, v1, v2);
+
+	// RenderTriangle_W5 visits [topLeft, botRight), so an empty range never reaches a tile
+	if (int(topLeft.x) >= int(botRight.x) || int(topLeft.y) >= int(botRight.y))
+	{
+		return;
+	}
+
+	const int minTileX{ int(topLeft.x) / TILE_SIZE };
+	const int minTileY{ int(topLeft.y) / TILE_SIZE };
+	const int maxTileX{ (int(botRight.x) - 1) / TILE_SIZE };
+	const int maxTileY{ (int(botRight.y) - 1) / TILE_SIZE };
+
+	for (int tileY = minTileY; tileY <= maxTileY; ++tileY)
+	{
+		for (int tileX = minTileX; tileX <= maxTileX; ++tileX)
+		{
+			m_Tiles[tileX + (tileY * m_NrTilesX)].triangleIndices.push_back(triangleIdx);
+		}
+	}
+}
+
+void Renderer::ClearTile(Tile& tile) const
+{
+	if (!tile.isClearPending)
+	{
+		return;
+	}
+	tile.isClearPending = false;
+
+	// The tile is one contiguous range of the depth buffer, 16-bit and 24-bit depth only touch the start of the buffer
+	const uint32_t depthClearValue{ GetDepthClearValue() };
+	const int firstPixelIdx{ GetPixelIndex(tile.minX, tile.minY) };
+	if (m_DepthFormat == DepthFormat::Unorm16)
+	{
+		std::fill_n(reinterpret_cast<uint16_t*>(m_pDepthBufferPixels) + firstPixelIdx, TILE_SIZE * TILE_SIZE, uint16_t(depthClearValue));
+	}
+	else if (m_DepthFormat == DepthFormat::Unorm24)
+	{
+		std::fill_n(reinterpret_cast<Depth24*>(m_pDepthBufferPixels) + firstPixelIdx, TILE_SIZE * TILE_SIZE, Depth24(depthClearValue));
+	}
+	else
+	{
+		std::fill_n(m_pDepthBufferPixels + firstPixelIdx, TILE_SIZE * TILE_SIZE, depthClearValue);
+	}
+
+	// Tiles are a multiple of the depth block size, so every block belongs to exactly one tile
+	for (int blockY{ tile.minY / DEPTH_BLOCK_SIZE }; blockY <= (tile.maxY - 1) / DEPTH_BLOCK_SIZE; ++blockY)
+	{
+		for (int blockX{ tile.minX / DEPTH_BLOCK_SIZE }; blockX <= (tile.maxX - 1) / DEPTH_BLOCK_SIZE; ++blockX)
+		{
+			m_pDepthBlocks[blockX + (blockY * m_NrDepthBlocksX)] = DepthBlock{ depthClearValue, depthClearValue };
+		}
+	}
+
+	// Entries of the last frame would point at triangles that no longer exist
+	if (m_IsVisibilityBufferEnabled)
+	{
+		std::fill_n(m_pVisibilityBuffer + firstPixelIdx, TILE_SIZE * TILE_SIZE, VisibilityEntry{});
+	}
+
+	ClearTileColor(tile);
+}
+
+void Renderer::ClearAllTiles()
+{
+	// For the solutions that draw straight to the buffers, the trailing color clear in Render then skips every tile
+	for (Tile& tile : m_Tiles)
+	{
+		ClearTile(tile);
+	}
+}
+
+void Renderer::ClearTileColor(const Tile& tile) const
+{
+	for (int py{ tile.minY }; py < tile.maxY; ++py)
+	{
+		std::fill_n(m_pBackBufferPixels + tile.minX + (py * m_Width), tile.maxX - tile.minX, m_ClearColor);
+	}
+}
+
+void Renderer::RenderTile(Tile& tile) const
+{
+	// Every tile keeps the binning order, so every pixel sees the same depth test sequence as a serial loop
+	for (uint32_t triangleIdx : tile.triangleIndices)
+	{
+		tile.nrDepthPassedFragments += RenderTriangle_W5(m_Triangles[triangleIdx], triangleIdx, tile);
+	}
+
+	if (m_IsVisibilityBufferEnabled)
+	{
+		ShadeVisibilityBuffer(tile);
+	}
+
+	tile.nrResolvedPixels = ResolveTile(tile);
+}
+
+void Renderer::VertexTransformationMatrix(Mesh* Mesh, const Matrix* pWorldMatrices, uint32_t nrInstances)
+{
+	/*
+	Optimizations
+	* Declare and define vertex_out outside the loop. Right now the destructor is being called at the end of each loop
+	* Don't pushback the values. Instead reserve and resize the vertices_out vector and fill in the values at idx
+	*/
+
+	std::array<Matrix, INSTANCE_BATCH_SIZE> WorldViewProjectionMatrices{};
+	for (uint32_t instanceIdx = 0; instanceIdx < nrInstances; ++instanceIdx)
+	{
+		WorldViewProjectionMatrices[instanceIdx] = pWorldMatrices[instanceIdx] * m_Camera.invViewMatrix * m_Camera.ProjectionMatrix;
+	}
+
+	if (m_IsAVX2Supported)
+	{
+		VertexTransformationMatrixAVX2(Mesh, pWorldMatrices, WorldViewProjectionMatrices.data(), nrInstances);
+		return;
+	}
+
+	const size_t nrVertices{ Mesh->vertices.size() };
+	for (size_t idx = 0; idx < nrVertices; ++idx)
+	{
+		// Vertices of culled clusters are never read this frame
+		const uint8_t referenceMask{ Mesh->vertexReferenceMasks[idx] };
+		if (referenceMask == 0)
+		{
+			continue;
+		}
+
+		// The input vertex is read once and written out for every instance of the batch that references it
+		const Vertex& vertex{ Mesh->vertices[idx] };
+		for (uint32_t instanceIdx = 0; instanceIdx < nrInstances; ++instanceIdx)
+		{
+			if ((referenceMask & (1 << instanceIdx)) == 0)
+			{
+				continue;
+			}
+
+			const Matrix& worldMatrix{ pWorldMatrices[instanceIdx] };
+			Vertex_Out& vertex_out{ Mesh->vertices_out[(instanceIdx * nrVertices) + idx] };
+
+			// Position Transformation To Clip Space
+			// The perspective divide happens after clipping, see ProjectToScreen
+			vertex_out.position = WorldViewProjectionMatrices[instanceIdx].TransformPoint(Vector4{ vertex.position, 1.f });
+			vertex_out.uv = vertex.uv;
+
+			// Normal & Tangent Transformation To World Space
+			vertex_out.normal = worldMatrix.TransformVector(vertex.normal);
+			vertex_out.tangent = worldMatrix.TransformVector(vertex.tangent);
+			vertex_out.normal.Normalize();
+			vertex_out.tangent.Normalize();
+
+			// Create ViewDirection
+			vertex_out.viewDirection = worldMatrix.TransformPoint(vertex.position) - m_Camera.origin;
+		}
+	}
+
+}
+
+void Renderer::VertexTransformationMatrixAVX2(Mesh* pMesh, const Matrix* pWorldMatrices, const Matrix* pWorldViewProjectionMatrices, uint32_t nrInstances)
+{
+	// Same operations in the same order as the scalar path, 8 vertices of the streams at a time
+	// Element (row * 4) + column of a broadcast matrix holds data[row][column] in every lane
+	__m256 worldMatrices[INSTANCE_BATCH_SIZE][16]{};
+	__m256 worldViewProjectionMatrices[INSTANCE_BATCH_SIZE][16]{};
+	for (uint32_t instanceIdx = 0; instanceIdx < nrInstances; ++instanceIdx)
+	{
+		for (int element = 0; element < 16; ++element)
+		{
+			worldMatrices[instanceIdx][element] = _mm256_set1_ps(pWorldMatrices[instanceIdx][element / 4][element % 4]);
+			worldViewProjectionMatrices[instanceIdx][element] = _mm256_set1_ps(pWorldViewProjectionMatrices[instanceIdx][element / 4][element % 4]);
+		}
+	}
+
+	// Column of v * M, with w = 1 for points and w = 0 for vectors
+	const auto transformPoint{ [](const __m256* pMatrix, int column, __m256 x, __m256 y, __m256 z)
+	{
+		return _mm256_add_ps(_mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(pMatrix[column], x), _mm256_mul_ps(pMatrix[4 + column], y)), _mm256_mul_ps(pMatrix[8 + column], z)), pMatrix[12 + column]);
+	} };
+	const auto transformVector{ [](const __m256* pMatrix, int column, __m256 x, __m256 y, __m256 z)
+	{
+		return _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(pMatrix[column], x), _mm256_mul_ps(pMatrix[4 + column], y)), _mm256_mul_ps(pMatrix[8 + column], z));
+	} };
+	const auto normalize{ [](__m256& x, __m256& y, __m256& z)
+	{
+		const __m256 magnitude{ _mm256_sqrt_ps(_mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(x, x), _mm256_mul_ps(y, y)), _mm256_mul_ps(z, z))) };
+		x = _mm256_div_ps(x, magnitude);
+		y = _mm256_div_ps(y, magnitude);
+		z = _mm256_div_ps(z, magnitude);
+	} };
+
+	const __m256 cameraX{ _mm256_set1_ps(m_Camera.origin.x) };
+	const __m256 cameraY{ _mm256_set1_ps(m_Camera.origin.y) };
+	const __m256 cameraZ{ _mm256_set1_ps(m_Camera.origin.z) };
+
+	const VertexStreams& streams{ pMesh->vertexStreams };
+	const size_t nrVertices{ pMesh->vertices.size() };
+	for (size_t blockStart = 0; blockStart < nrVertices; blockStart += VERTEX_STREAM_WIDTH)
+	{
+		// Bit i of a lane mask is set when the instance references vertex blockStart + i
+		const size_t nrLanes{ std::min(size_t(VERTEX_STREAM_WIDTH), nrVertices - blockStart) };
+		uint8_t laneMasks[INSTANCE_BATCH_SIZE]{};
+		for (size_t lane = 0; lane < nrLanes; ++lane)
+		{
+			const uint8_t referenceMask{ pMesh->vertexReferenceMasks[blockStart + lane] };
+			for (uint32_t instanceIdx = 0; instanceIdx < nrInstances; ++instanceIdx)
+			{
+				if (referenceMask & (1 << instanceIdx))
+				{
+					laneMasks[instanceIdx] |= uint8_t(1 << lane);
+				}
+			}
+		}
+
+		const __m256 positionX{ _mm256_loadu_ps(streams.positionX.data() + blockStart) };
+		const __m256 positionY{ _mm256_loadu_ps(streams.positionY.data() + blockStart) };
+		const __m256 positionZ{ _mm256_loadu_ps(streams.positionZ.data() + blockStart) };
+		const __m256 normalX{ _mm256_loadu_ps(streams.normalX.data() + blockStart) };
+		const __m256 normalY{ _mm256_loadu_ps(streams.normalY.data() + blockStart) };
+		const __m256 normalZ{ _mm256_loadu_ps(streams.normalZ.data() + blockStart) };
+		const __m256 tangentX{ _mm256_loadu_ps(streams.tangentX.data() + blockStart) };
+		const __m256 tangentY{ _mm256_loadu_ps(streams.tangentY.data() + blockStart) };
+		const __m256 tangentZ{ _mm256_loadu_ps(streams.tangentZ.data() + blockStart) };
+
+		for (uint32_t instanceIdx = 0; instanceIdx < nrInstances; ++instanceIdx)
+		{
+			if (laneMasks[instanceIdx] == 0)
+			{
+				continue;
+			}
+
+			const __m256* pWorldMatrix{ worldMatrices[instanceIdx] };
+			const __m256* pWorldViewProjectionMatrix{ worldViewProjectionMatrices[instanceIdx] };
+
+			// Position Transformation To Clip Space
+			// The perspective divide happens after clipping, see ProjectToScreen
+			alignas(32) float lanes[13][VERTEX_STREAM_WIDTH];
+			for (int column = 0; column < 4; ++column)
+			{
+				_mm256_store_ps(lanes[column], transformPoint(pWorldViewProjectionMatrix, column, positionX, positionY, positionZ));
+			}
+
+			// Normal & Tangent Transformation To World Space
+			__m256 worldNormalX{ transformVector(pWorldMatrix, 0, normalX, normalY, normalZ) };
+			__m256 worldNormalY{ transformVector(pWorldMatrix, 1, normalX, normalY, normalZ) };
+			__m256 worldNormalZ{ transformVector(pWorldMatrix, 2, normalX, normalY, normalZ) };
+			__m256 worldTangentX{ transformVector(pWorldMatrix, 0, tangentX, tangentY, tangentZ) };
+			__m256 worldTangentY{ transformVector(pWorldMatrix, 1, tangentX, tangentY, tangentZ) };
+			__m256 worldTangentZ{ transformVector(pWorldMatrix, 2, tangentX, tangentY, tangentZ) };
+			normalize(worldNormalX, worldNormalY, worldNormalZ);
+			normalize(worldTangentX, worldTangentY, worldTangentZ);
+			_mm256_store_ps(lanes[4], worldNormalX);
+			_mm256_store_ps(lanes[5], worldNormalY);
+			_mm256_store_ps(lanes[6], worldNormalZ);
+			_mm256_store_ps(lanes[7], worldTangentX);
+			_mm256_store_ps(lanes[8], worldTangentY);
+			_mm256_store_ps(lanes[9], worldTangentZ);
+
+			// Create ViewDirection
+			_mm256_store_ps(lanes[10], _mm256_sub_ps(transformPoint(pWorldMatrix, 0, positionX, positionY, positionZ), cameraX));
+			_mm256_store_ps(lanes[11], _mm256_sub_ps(transformPoint(pWorldMatrix, 1, positionX, positionY, positionZ), cameraY));
+			_mm256_store_ps(lanes[12], _mm256_sub_ps(transformPoint(pWorldMatrix, 2, positionX, positionY, positionZ), cameraZ));
+
+			// Assembly reads whole vertices, so the lanes are written back as Vertex_Out
+			Vertex_Out* pVertices{ pMesh->vertices_out.data() + (instanceIdx * nrVertices) + blockStart };
+			for (size_t lane = 0; lane < nrLanes; ++lane)
+			{
+				if ((laneMasks[instanceIdx] & (1 << lane)) == 0)
+				{
+					continue;
+				}
+
+				Vertex_Out& vertex_out{ pVertices[lane] };
+				vertex_out.position = { lanes[0][lane], lanes[1][lane], lanes[2][lane], lanes[3][lane] };
+				vertex_out.uv = { streams.u[blockStart + lane], streams.v[blockStart + lane] };
+				vertex_out.normal = { lanes[4][lane], lanes[5][lane], lanes[6][lane] };
+				vertex_out.tangent = { lanes[7][lane], lanes[8][lane], lanes[9][lane] };
+				vertex_out.viewDirection = { lanes[10][lane], lanes[11][lane], lanes[12][lane] };
+			}
+		}
+	}
+	_mm256_zeroupper();
+}
+
+
+void Renderer::VertexTransformationDepthOnly(Mesh* Mesh, const Matrix* pWorldMatrices, uint32_t nrInstances)
+{
+	std::array<Matrix, INSTANCE_BATCH_SIZE> WorldViewProjectionMatrices{};
+	for (uint32_t instanceIdx = 0; instanceIdx < nrInstances; ++instanceIdx)
+	{
+		WorldViewProjectionMatrices[instanceIdx] = pWorldMatrices[instanceIdx] * m_Camera.invViewMatrix * m_Camera.ProjectionMatrix;
+	}
+
+	// One position transform per set bit, the masks only have bits for the instances of this batch
+	for (uint8_t referenceMask : Mesh->vertexReferenceMasks)
+	{
+		m_NrPositionTransforms += std::popcount(referenceMask);
+	}
+
+	if (m_IsAVX2Supported)
+	{
+		VertexTransformationDepthOnlyAVX2(Mesh, WorldViewProjectionMatrices.data(), nrInstances);
+		return;
+	}
+
+	const size_t nrVertices{ Mesh->vertices.size() };
+	for (size_t idx = 0; idx < nrVertices; ++idx)
+	{
+		const uint8_t referenceMask{ Mesh->vertexReferenceMasks[idx] };
+		if (referenceMask == 0)
+		{
+			continue;
+		}
+
+		const Vector4 position{ Mesh->vertices[idx].position, 1.f };
+		for (uint32_t instanceIdx = 0; instanceIdx < nrInstances; ++instanceIdx)
+		{
+			// Position Transformation To Clip Space
+			if (referenceMask & (1 << instanceIdx))
+			{
+				Mesh->positions_out[(instanceIdx * nrVertices) + idx] = WorldViewProjectionMatrices[instanceIdx].TransformPoint(position);
+			}
+		}
+	}
+}
+
+void Renderer::VertexTransformationDepthOnlyAVX2(Mesh* pMesh, const Matrix* pWorldViewProjectionMatrices, uint32_t nrInstances)
+{
+	// Position part of VertexTransformationMatrixAVX2
+	__m256 worldViewProjectionMatrices[INSTANCE_BATCH_SIZE][16]{};
+	for (uint32_t instanceIdx = 0; instanceIdx < nrInstances; ++instanceIdx)
+	{
+		for (int element = 0; element < 16; ++element)
+		{
+			worldViewProjectionMatrices[instanceIdx][element] = _mm256_set1_ps(pWorldViewProjectionMatrices[instanceIdx][element / 4][element % 4]);
+		}
+	}
+
+	const VertexStreams& streams{ pMesh->vertexStreams };
+	const size_t nrVertices{ pMesh->vertices.size() };
+	for (size_t blockStart = 0; blockStart < nrVertices; blockStart += VERTEX_STREAM_WIDTH)
+	{
+		const size_t nrLanes{ std::min(size_t(VERTEX_STREAM_WIDTH), nrVertices - blockStart) };
+		uint8_t laneMasks[INSTANCE_BATCH_SIZE]{};
+		for (size_t lane = 0; lane < nrLanes; ++lane)
+		{
+			const uint8_t referenceMask{ pMesh->vertexReferenceMasks[blockStart + lane] };
+			for (uint32_t instanceIdx = 0; instanceIdx < nrInstances; ++instanceIdx)
+			{
+				if (referenceMask & (1 << instanceIdx))
+				{
+					laneMasks[instanceIdx] |= uint8_t(1 << lane);
+				}
+			}
+		}
+
+		const __m256 positionX{ _mm256_loadu_ps(streams.positionX.data() + blockStart) };
+		const __m256 positionY{ _mm256_loadu_ps(streams.positionY.data() + blockStart) };
+		const __m256 positionZ{ _mm256_loadu_ps(streams.positionZ.data() + blockStart) };
+
+		for (uint32_t instanceIdx = 0; instanceIdx < nrInstances; ++instanceIdx)
+		{
+			if (laneMasks[instanceIdx] == 0)
+			{
+				continue;
+			}
+
+			// Position Transformation To Clip Space
+			const __m256* pMatrix{ worldViewProjectionMatrices[instanceIdx] };
+			alignas(32) float lanes[4][VERTEX_STREAM_WIDTH];
+			for (int column = 0; column < 4; ++column)
+			{
+				_mm256_store_ps(lanes[column], _mm256_add_ps(_mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(pMatrix[column], positionX), _mm256_mul_ps(pMatrix[4 + column], positionY)), _mm256_mul_ps(pMatrix[8 + column], positionZ)), pMatrix[12 + column]));
+			}
+
+			Vector4* pPositions{ pMesh->positions_out.data() + (instanceIdx * nrVertices) + blockStart };
+			for (size_t lane = 0; lane < nrLanes; ++lane)
+			{
+				if (laneMasks[instanceIdx] & (1 << lane))
+				{
+					pPositions[lane] = { lanes[0][lane], lanes[1][lane], lanes[2][lane], lanes[3][lane] };
+				}
+			}
+		}
+	}
+	_mm256_zeroupper();
+}
+
+void Renderer::ProjectToScreen(Vector4& position) const
+{
+	// Perspective Divide, w is kept for perspective correct interpolation
+	position.x /= position.w;
+	position.y /= position.w;
+	position.z /= position.w;
+
+	// NDC -> Screen Space Coordinates
+	position.x = ((1 + position.x) / 2) * m_Width;
+	position.y = ((1 - position.y) / 2) * m_Height;
+}
+
+void Renderer::FindBoundingBoxCorners(Vector2& topLeft, Vector2& botRight, const Vector2& v0, const Vector2& v1, const Vector2& v2) const
+{
+	// Pixels [topLeft, botRight) hold every pixel center the triangle can cover
+	topLeft.x = std::min(std::min(v0.x, v1.x), v2.x);
+	topLeft.x = Clamp(std::floor(topLeft.x), 0.f, float(m_Width - 1));
+	topLeft.y = std::min(std::min(v0.y, v1.y), v2.y);
+	topLeft.y = Clamp(std::floor(topLeft.y), 0.f, float(m_Height - 1));
+
+	botRight.x = std::max(std::max(v0.x, v1.x), v2.x);
+	botRight.x = Clamp(std::ceil(botRight.x), 0.f, float(m_Width));
+
+	botRight.y = std::max(std::max(v0.y, v1.y), v2.y);
+	botRight.y = Clamp(std::ceil(botRight.y), 0.f, float(m_Height));
+}
+
+bool Renderer::SetupRasterTriangle(const Vector3& v0, const Vector3& v1, const Vector3& v2, RasterSetup& setup) const
+{
+	// Snap the vertices to the sub-pixel grid, every edge test below is exact integer math
+	const int64_t x[3]{ std::llround(v0.x * SUBPIXEL_SCALE), std::llround(v1.x * SUBPIXEL_SCALE), std::llround(v2.x * SUBPIXEL_SCALE) };
+	const int64_t y[3]{ std::llround(v0.y * SUBPIXEL_SCALE), std::llround(v1.y * SUBPIXEL_SCALE), std::llround(v2.y * SUBPIXEL_SCALE) };
+
+	std::array<EdgeEquation, 3>& edges{ setup.edges };
+
+	// edges[i] is the edge opposite vertex i, so it evaluates to the (scaled) barycentric weight of vertex i
+	for (int idx = 0; idx < 3; ++idx)
+	{
+		const int from{ (idx + 1) % 3 };
+		const int to{ (idx + 2) % 3 };
+
+		edges[idx].a = y[from] - y[to];
+		edges[idx].b = x[to] - x[from];
+		edges[idx].c = -(edges[idx].a * x[from]) - (edges[idx].b * y[from]);
+	}
+
+	int64_t area{ edges[0].a * x[0] + edges[0].b * y[0] + edges[0].c };
+	if (area == 0)
+	{
+		return false;
+	}
+
+	// Both windings get rasterized, flip the edges so the inside is always positive
+	if (area < 0)
+	{
+		for (EdgeEquation& edge : edges)
+		{
+			edge.a = -edge.a;
+			edge.b = -edge.b;
+			edge.c = -edge.c;
+		}
+		area = -area;
+	}
+
+	// Top-left fill rule: a pixel center exactly on a shared edge belongs to only one of the two triangles
+	for (EdgeEquation& edge : edges)
+	{
+		const bool isLeftEdge{ edge.a > 0 };
+		const bool isTopEdge{ edge.a == 0 && edge.b > 0 };
+		edge.bias = (isLeftEdge || isTopEdge) ? 0 : -1;
+	}
+
+	setup.invArea = 1.f / float(area);
+
+	setup.depth = { v0.z, v1.z, v2.z };
+
+	const uint32_t depthKeys[3]{ EncodeDepth(v0.z), EncodeDepth(v1.z), EncodeDepth(v2.z) };
+	setup.nearestDepth = std::min(std::min(depthKeys[0], depthKeys[1]), depthKeys[2]);
+	setup.farthestDepth = std::max(std::max(depthKeys[0], depthKeys[1]), depthKeys[2]);
+
+	return true;
+}
+
+uint16_t Renderer::GetSmallTriangleCoverage(const RasterSetup& setup, int minX, int minY, int maxX, int maxY) const
+{
+	const std::array<EdgeEquation, 3>& edges{ setup.edges };
+	const int64_t startX{ (int64_t(minX) << SUBPIXEL_BITS) + (SUBPIXEL_SCALE / 2) };
+	const int64_t startY{ (int64_t(minY) << SUBPIXEL_BITS) + (SUBPIXEL_SCALE / 2) };
+
+	// Every candidate pixel center is tested without branches, pixels outside the footprint are masked off afterwards
+	uint16_t coverageMask{};
+	for (int sampleIdx = 0; sampleIdx < SMALL_TRIANGLE_SIZE * SMALL_TRIANGLE_SIZE; ++sampleIdx)
+	{
+		const int64_t sampleX{ startX + (int64_t(sampleIdx % SMALL_TRIANGLE_SIZE) << SUBPIXEL_BITS) };
+		const int64_t sampleY{ startY + (int64_t(sampleIdx / SMALL_TRIANGLE_SIZE) << SUBPIXEL_BITS) };
+
+		const int64_t edge0{ edges[0].a * sampleX + edges[0].b * sampleY + edges[0].c + edges[0].bias };
+		const int64_t edge1{ edges[1].a * sampleX + edges[1].b * sampleY + edges[1].c + edges[1].bias };
+		const int64_t edge2{ edges[2].a * sampleX + edges[2].b * sampleY + edges[2].c + edges[2].bias };
+
+		coverageMask |= uint16_t(uint16_t((edge0 | edge1 | edge2) >= 0) << sampleIdx);
+	}
+
+	uint16_t footprintMask{};
+	for (int y = 0; y < maxY - minY; ++y)
+	{
+		footprintMask |= uint16_t(((1 << (maxX - minX)) - 1) << (y * SMALL_TRIANGLE_SIZE));
+	}
+
+	return coverageMask & footprintMask;
+}
+
+BlockCoverage Renderer::ClassifyBlock(const RasterSetup& setup, int minX, int minY, int maxX, int maxY) const
+{
+	// The edges are linear, so over the block they are smallest and largest at the corner pixel centers
+	const int64_t cornerX[2]{ (int64_t(minX) << SUBPIXEL_BITS) + (SUBPIXEL_SCALE / 2), (int64_t(maxX - 1) << SUBPIXEL_BITS) + (SUBPIXEL_SCALE / 2) };
+	const int64_t cornerY[2]{ (int64_t(minY) << SUBPIXEL_BITS) + (SUBPIXEL_SCALE / 2), (int64_t(maxY - 1) << SUBPIXEL_BITS) + (SUBPIXEL_SCALE / 2) };
+
+	bool isFullyCovered{ true };
+	for (const EdgeEquation& edge : setup.edges)
+	{
+		const int64_t edgeX0{ edge.a * cornerX[0] };
+		const int64_t edgeX1{ edge.a * cornerX[1] };
+		const int64_t edgeY0{ edge.b * cornerY[0] + edge.c + edge.bias };
+		const int64_t edgeY1{ edge.b * cornerY[1] + edge.c + edge.bias };
+
+		const int64_t minEdge{ std::min(edgeX0, edgeX1) + std::min(edgeY0, edgeY1) };
+		const int64_t maxEdge{ std::max(edgeX0, edgeX1) + std::max(edgeY0, edgeY1) };
+
+		if (maxEdge < 0)
+		{
+			return BlockCoverage::Outside;
+		}
+		if (minEdge < 0)
+		{
+			isFullyCovered = false;
+		}
+	}
+
+	return isFullyCovered ? BlockCoverage::Full : BlockCoverage::Partial;
+}
+
+bool Renderer::IsOccluded(uint32_t nearestDepth, int minX, int minY, int maxX, int maxY, DepthTest depthTest) const
+{
+	for (int blockY{ minY / DEPTH_BLOCK_SIZE }; blockY <= (maxY - 1) / DEPTH_BLOCK_SIZE; ++blockY)
+	{
+		for (int blockX{ minX / DEPTH_BLOCK_SIZE }; blockX <= (maxX - 1) / DEPTH_BLOCK_SIZE; ++blockX)
+		{
+			if (!IsBlockOccluding(m_pDepthBlocks[blockX + (blockY * m_NrDepthBlocksX)], nearestDepth, depthTest))
+			{
+				return false;
+			}
+		}
+	}
+
+	return true;
+}
+
+bool Renderer::IsBlockOccluding(const DepthBlock& block, uint32_t nearestDepth, DepthTest depthTest) const
+{
+	// An equal test still passes where the triangle touches the farthest stored depth
+	if (depthTest == DepthTest::Equal)
+	{
+		return nearestDepth > block.maxDepth;
+	}
+
+	return nearestDepth >= block.maxDepth;
+}
+
+void Renderer::UpdateDepthBlock(int blockX, int blockY) const
+{
+	const int minX{ blockX * DEPTH_BLOCK_SIZE };
+	const int minY{ blockY * DEPTH_BLOCK_SIZE };
+	const int maxX{ std::min(minX + DEPTH_BLOCK_SIZE, m_Width) };
+	const int maxY{ std::min(minY + DEPTH_BLOCK_SIZE, m_Height) };
+
+	DepthBlock& block{ m_pDepthBlocks[blockX + (blockY * m_NrDepthBlocksX)] };
+
+	// Full blocks are one 8-wide row per register, keys are below 2^31 so signed compares are fine
+	if (m_IsAVX2Supported && maxX - minX == 8)
+	{
+		__m256i minDepth{ _mm256_set1_epi32(INT32_MAX) };
+		__m256i maxDepth{ _mm256_setzero_si256() };
+		for (int py{ minY }; py < maxY; ++py)
+		{
+			const __m256i depth
+			{
+				m_DepthFormat == DepthFormat::Unorm16 ?
+				_mm256_cvtepu16_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i*>(reinterpret_cast<const uint16_t*>(m_pDepthBufferPixels) + GetPixelIndex(minX, py)))) :
+				m_DepthFormat == DepthFormat::Unorm24 ?
+				LoadDepthSpan(reinterpret_cast<const Depth24*>(m_pDepthBufferPixels) + GetPixelIndex(minX, py), 0xFF, _mm256_set1_epi32(-1)) :
+				_mm256_loadu_si256(reinterpret_cast<const __m256i*>(m_pDepthBufferPixels + GetPixelIndex(minX, py)))
+			};
+			minDepth = _mm256_min_epi32(minDepth, depth);
+			maxDepth = _mm256_max_epi32(maxDepth, depth);
+		}
+
+		alignas(32) uint32_t minLanes[8]{};
+		alignas(32) uint32_t maxLanes[8]{};
+		_mm256_store_si256(reinterpret_cast<__m256i*>(minLanes), minDepth);
+		_mm256_store_si256(reinterpret_cast<__m256i*>(maxLanes), maxDepth);
+		_mm256_zeroupper();
+
+		block.minDepth = *std::min_element(minLanes, minLanes + 8);
+		block.maxDepth = *std::max_element(maxLanes, maxLanes + 8);
+		return;
+	}
+
+	block.minDepth = UINT32_MAX;
+	block.maxDepth = 0;
+
+	for (int py{ minY }; py < maxY; ++py)
+	{
+		for (int px{ minX }; px < maxX; ++px)
+		{
+			const uint32_t depth{ GetStoredDepth(GetPixelIndex(px, py)) };
+			block.minDepth = std::min(block.minDepth, depth);
+			block.maxDepth = std::max(block.maxDepth, depth);
+		}
+	}
+}
+
+uint32_t Renderer::GetStoredDepth(int pixelIdx) const
+{
+	if (m_DepthFormat == DepthFormat::Unorm16)
+	{
+		return reinterpret_cast<const uint16_t*>(m_pDepthBufferPixels)[pixelIdx];
+	}
+	if (m_DepthFormat == DepthFormat::Unorm24)
+	{
+		return reinterpret_cast<const Depth24*>(m_pDepthBufferPixels)[pixelIdx];
+	}
+
+	return m_pDepthBufferPixels[pixelIdx];
+}
+
+uint32_t Renderer::GetDepthClearValue() const
+{
+	// Every key a fragment can produce compares less, except the far plane itself in 16-bit and 24-bit
+	switch (m_DepthFormat)
+	{
+	case DepthFormat::Unorm16:
+		return DEPTH_UNORM16_MAX;
+	case DepthFormat::Unorm24:
+		return DEPTH_UNORM24_MAX;
+	default:
+		return INT32_MAX;
+	}
+}
+
+uint32_t Renderer::EncodeDepth(float depth) const
+{
+	// Keys grow with the distance to the camera in every format, so the depth test is always an integer less-than
+	// The clamp also turns -0 into +0, which would otherwise sort behind everything as a float bit pattern
+	const float clampedDepth{ depth > 0.f ? std::min(depth, 1.f) : 0.f };
+
+	switch (m_DepthFormat)
+	{
+	case DepthFormat::ReversedFloat32:
+		return DEPTH_REVERSED_NEAR - std::bit_cast<uint32_t>(clampedDepth);
+	case DepthFormat::Unorm24:
+		return uint32_t(std::nearbyint(clampedDepth * float(DEPTH_UNORM24_MAX)));
+	case DepthFormat::Unorm16:
+		return uint32_t(std::nearbyint(clampedDepth * float(DEPTH_UNORM16_MAX)));
+	default:
+		// Positive floats sort like their bit patterns
+		return std::bit_cast<uint32_t>(clampedDepth);
+	}
+}
+
+__m256i Renderer::EncodeDepthAVX2(__m256 depth) const
+{
+	// Same as EncodeDepth, max/min return the second operand for NaN and equal zeros just like the scalar clamp
+	const __m256 clampedDepth{ _mm256_min_ps(_mm256_max_ps(depth, _mm256_setzero_ps()), _mm256_set1_ps(1.f)) };
+
+	switch (m_DepthFormat)
+	{
+	case DepthFormat::ReversedFloat32:
+		return _mm256_sub_epi32(_mm256_set1_epi32(int(DEPTH_REVERSED_NEAR)), _mm256_castps_si256(clampedDepth));
+	case DepthFormat::Unorm24:
+		return _mm256_cvtps_epi32(_mm256_mul_ps(clampedDepth, _mm256_set1_ps(float(DEPTH_UNORM24_MAX))));
+	case DepthFormat::Unorm16:
+		return _mm256_cvtps_epi32(_mm256_mul_ps(clampedDepth, _mm256_set1_ps(float(DEPTH_UNORM16_MAX))));
+	default:
+		return _mm256_castps_si256(clampedDepth);
+	}
+}
+
+template<typename PixelShader>
+void Renderer::RasterizeTriangle(const RasterSetup& setup, int minX, int minY, int maxX, int maxY, DepthTest depthTest, const PixelShader& shadePixel) const
+{
+	if (minX >= maxX || minY >= maxY)
+	{
+		return;
+	}
+
+	// 16-bit and 24-bit depth get their own instantiation of the kernels, the other formats all store 32-bit keys
+	const bool isDepth16{ m_DepthFormat == DepthFormat::Unorm16 };
+	const bool isDepth24{ m_DepthFormat == DepthFormat::Unorm24 };
+
+	if (setup.smallCoverageMask != 0)
+	{
+		isDepth16 ?
+			RasterizeSmallTriangle<uint16_t>(setup, minX, minY, depthTest, shadePixel) :
+		isDepth24 ?
+			RasterizeSmallTriangle<Depth24>(setup, minX, minY, depthTest, shadePixel) :
+			RasterizeSmallTriangle<uint32_t>(setup, minX, minY, depthTest, shadePixel);
+		return;
+	}
+
+	// The interpolated depth is a weighted average of the vertex depths, so it never leaves [nearestDepth, farthestDepth]
+	for (int blockY{ minY / DEPTH_BLOCK_SIZE }; blockY <= (maxY - 1) / DEPTH_BLOCK_SIZE; ++blockY)
+	{
+		for (int blockX{ minX / DEPTH_BLOCK_SIZE }; blockX <= (maxX - 1) / DEPTH_BLOCK_SIZE; ++blockX)
+		{
+			const DepthBlock& block{ m_pDepthBlocks[blockX + (blockY * m_NrDepthBlocksX)] };
+
+			// Hierarchical Z: everything the triangle could write is behind the farthest depth already in the block
+			if (IsBlockOccluding(block, setup.nearestDepth, depthTest))
+			{
+				continue;
+			}
+
+			// With a less test, a triangle entirely in front of the nearest depth in the block passes without reading it
+			const bool isDepthTestRequired{ depthTest == DepthTest::Equal || setup.farthestDepth >= block.minDepth };
+
+			const int blockMinX{ std::max(minX, blockX * DEPTH_BLOCK_SIZE) };
+			const int blockMinY{ std::max(minY, blockY * DEPTH_BLOCK_SIZE) };
+			const int blockMaxX{ std::min(maxX, (blockX + 1) * DEPTH_BLOCK_SIZE) };
+			const int blockMaxY{ std::min(maxY, (blockY + 1) * DEPTH_BLOCK_SIZE) };
+
+			// Trivial reject/accept: blocks outside the triangle are skipped, fully covered ones need no per-pixel edge tests
+			const BlockCoverage coverage{ ClassifyBlock(setup, blockMinX, blockMinY, blockMaxX, blockMaxY) };
+			if (coverage == BlockCoverage::Outside)
+			{
+				continue;
+			}
+			const bool isFullyCovered{ coverage == BlockCoverage::Full };
+
+			bool isDepthWritten{};
+			if (m_IsAVX2Supported)
+			{
+				isDepthWritten = isDepth16 ?
+					RasterizeRectAVX2<uint16_t>(setup, blockMinX, blockMinY, blockMaxX, blockMaxY, depthTest, isDepthTestRequired, isFullyCovered, shadePixel) :
+					isDepth24 ?
+					RasterizeRectAVX2<Depth24>(setup, blockMinX, blockMinY, blockMaxX, blockMaxY, depthTest, isDepthTestRequired, isFullyCovered, shadePixel) :
+					RasterizeRectAVX2<uint32_t>(setup, blockMinX, blockMinY, blockMaxX, blockMaxY, depthTest, isDepthTestRequired, isFullyCovered, shadePixel);
+			}
+			else
+			{
+				isDepthWritten = isDepth16 ?
+					RasterizeRect<uint16_t>(setup, blockMinX, blockMinY, blockMaxX, blockMaxY, depthTest, isDepthTestRequired, isFullyCovered, shadePixel) :
+					isDepth24 ?
+					RasterizeRect<Depth24>(setup, blockMinX, blockMinY, blockMaxX, blockMaxY, depthTest, isDepthTestRequired, isFullyCovered, shadePixel) :
+					RasterizeRect<uint32_t>(setup, blockMinX, blockMinY, blockMaxX, blockMaxY, depthTest, isDepthTestRequired, isFullyCovered, shadePixel);
+			}
+
+			if (isDepthWritten)
+			{
+				UpdateDepthBlock(blockX, blockY);
+			}
+		}
+	}
+}
+
+template<typename DepthType, typename PixelShader>
+void Renderer::RasterizeSmallTriangle(const RasterSetup& setup, int minX, int minY, DepthTest depthTest, const PixelShader& shadePixel) const
+{
+	const std::array<EdgeEquation, 3>& edges{ setup.edges };
+	DepthType* pDepthBuffer{ reinterpret_cast<DepthType*>(m_pDepthBufferPixels) };
+
+	// The footprint is at most 4x4 pixels, so it touches at most 2x2 depth blocks
+	const int minBlockX{ minX / DEPTH_BLOCK_SIZE };
+	const int minBlockY{ minY / DEPTH_BLOCK_SIZE };
+	int writtenBlockMask{};
+
+	// Only the covered pixels are visited, the coverage was already computed during setup
+	for (uint32_t coverageMask{ setup.smallCoverageMask }; coverageMask != 0; coverageMask &= coverageMask - 1)
+	{
+		const int sampleIdx{ std::countr_zero(coverageMask) };
+		const int px{ minX + (sampleIdx % SMALL_TRIANGLE_SIZE) };
+		const int py{ minY + (sampleIdx / SMALL_TRIANGLE_SIZE) };
+
+		const int64_t sampleX{ (int64_t(px) << SUBPIXEL_BITS) + (SUBPIXEL_SCALE / 2) };
+		const int64_t sampleY{ (int64_t(py) << SUBPIXEL_BITS) + (SUBPIXEL_SCALE / 2) };
+		const Vector3 weights
+		{
+			float(edges[0].a * sampleX + edges[0].b * sampleY + edges[0].c) * setup.invArea,
+			float(edges[1].a * sampleX + edges[1].b * sampleY + edges[1].c) * setup.invArea,
+			float(edges[2].a * sampleX + edges[2].b * sampleY + edges[2].c) * setup.invArea
+		};
+
+		const float depth{ (weights.x * setup.depth[0]) + (weights.y * setup.depth[1]) + (weights.z * setup.depth[2]) };
+		const uint32_t depthKey{ EncodeDepth(depth) };
+
+		DepthType& storedDepth{ pDepthBuffer[GetPixelIndex(px, py)] };
+		if (depthTest == DepthTest::Equal ? depthKey == storedDepth : depthKey < storedDepth)
+		{
+			if (depthTest == DepthTest::Less)
+			{
+				storedDepth = DepthType(depthKey);
+				writtenBlockMask |= 1 << ((px / DEPTH_BLOCK_SIZE - minBlockX) + 2 * (py / DEPTH_BLOCK_SIZE - minBlockY));
+			}
+			shadePixel(px, py, weights, depth);
+		}
+	}
+
+	for (; writtenBlockMask != 0; writtenBlockMask &= writtenBlockMask - 1)
+	{
+		const int blockIdx{ std::countr_zero(uint32_t(writtenBlockMask)) };
+		UpdateDepthBlock(minBlockX + (blockIdx % 2), minBlockY + (blockIdx / 2));
+	}
+}
+
+template<typename DepthType, typename PixelShader>
+bool Renderer::RasterizeRect(const RasterSetup& setup, int minX, int minY, int maxX, int maxY, DepthTest depthTest, bool isDepthTestRequired, bool isFullyCovered, const PixelShader& shadePixel) const
+{
+	const std::array<EdgeEquation, 3>& edges{ setup.edges };
+	DepthType* pDepthBuffer{ reinterpret_cast<DepthType*>(m_pDepthBufferPixels) };
+	bool isDepthWritten{};
+
+	// Edge values at the center of the first pixel, afterwards they are only stepped
+	const int64_t startX{ (int64_t(minX) << SUBPIXEL_BITS) + (SUBPIXEL_SCALE / 2) };
+	const int64_t startY{ (int64_t(minY) << SUBPIXEL_BITS) + (SUBPIXEL_SCALE / 2) };
+
+	int64_t edgeRow[3]{};
+	int64_t edgeStepX[3]{};
+	int64_t edgeStepY[3]{};
+	for (int idx = 0; idx < 3; ++idx)
+	{
+		edgeRow[idx] = edges[idx].a * startX + edges[idx].b * startY + edges[idx].c + edges[idx].bias;
+		edgeStepX[idx] = edges[idx].a * SUBPIXEL_SCALE;
+		edgeStepY[idx] = edges[idx].b * SUBPIXEL_SCALE;
+	}
+
+	for (int py{ minY }; py < maxY; ++py)
+	{
+		int64_t edge0{ edgeRow[0] };
+		int64_t edge1{ edgeRow[1] };
+		int64_t edge2{ edgeRow[2] };
+
+		for (int px{ minX }; px < maxX; ++px)
+		{
+			// Sign bit of the or'ed edges is set as soon as one edge is negative
+			if (isFullyCovered || (edge0 | edge1 | edge2) >= 0)
+			{
+				const Vector3 weights
+				{
+					float(edge0 - edges[0].bias) * setup.invArea,
+					float(edge1 - edges[1].bias) * setup.invArea,
+					float(edge2 - edges[2].bias) * setup.invArea
+				};
+
+				const float depth{ (weights.x * setup.depth[0]) + (weights.y * setup.depth[1]) + (weights.z * setup.depth[2]) };
+				const uint32_t depthKey{ EncodeDepth(depth) };
+
+				DepthType& storedDepth{ pDepthBuffer[GetPixelIndex(px, py)] };
+				const bool isDepthPassed
+				{
+					depthTest == DepthTest::Equal ?
+					depthKey == storedDepth :
+					!isDepthTestRequired || depthKey < storedDepth
+				};
+
+				if (isDepthPassed)
+				{
+					// An equal test runs against a finished depth buffer, there is nothing left to write
+					if (depthTest == DepthTest::Less)
+					{
+						storedDepth = DepthType(depthKey);
+						isDepthWritten = true;
+					}
+					shadePixel(px, py, weights, depth);
+				}
+			}
+
+			edge0 += edgeStepX[0];
+			edge1 += edgeStepX[1];
+			edge2 += edgeStepX[2];
+		}
+
+		edgeRow[0] += edgeStepY[0];
+		edgeRow[1] += edgeStepY[1];
+		edgeRow[2] += edgeStepY[2];
+	}
+
+	return isDepthWritten;
+}
+
+template<typename DepthType, typename PixelShader>
+bool Renderer::RasterizeRectAVX2(const RasterSetup& setup, int minX, int minY, int maxX, int maxY, DepthTest depthTest, bool isDepthTestRequired, bool isFullyCovered, const PixelShader& shadePixel) const
+{
+	// Same traversal as the scalar loop, but 8 horizontal pixels (one 8x1 span) per iteration
+	const std::array<EdgeEquation, 3>& edges{ setup.edges };
+	bool isDepthWritten{};
+
+	const int64_t startX{ (int64_t(minX) << SUBPIXEL_BITS) + (SUBPIXEL_SCALE / 2) };
+	const int64_t startY{ (int64_t(minY) << SUBPIXEL_BITS) + (SUBPIXEL_SCALE / 2) };
+
+	int64_t edgeRow[3]{};
+	int64_t edgeStepSpan[3]{};
+	int64_t edgeStepY[3]{};
+	__m256i edgeLaneOffsetLo[3]{};
+	__m256i edgeLaneOffsetHi[3]{};
+	__m256 weightStepX[3]{};
+	for (int idx = 0; idx < 3; ++idx)
+	{
+		const int64_t stepX{ edges[idx].a * SUBPIXEL_SCALE };
+
+		edgeRow[idx] = edges[idx].a * startX + edges[idx].b * startY + edges[idx].c + edges[idx].bias;
+		edgeStepSpan[idx] = stepX * 8;
+		edgeStepY[idx] = edges[idx].b * SUBPIXEL_SCALE;
+
+		// The edges stay 64-bit so coverage is exactly the scalar result, 4 lanes per register
+		edgeLaneOffsetLo[idx] = _mm256_setr_epi64x(0, stepX, stepX * 2, stepX * 3);
+		edgeLaneOffsetHi[idx] = _mm256_setr_epi64x(stepX * 4, stepX * 5, stepX * 6, stepX * 7);
+		weightStepX[idx] = _mm256_set1_ps(float(stepX) * setup.invArea);
+	}
+
+	const __m256 laneIdx{ _mm256_setr_ps(0.f, 1.f, 2.f, 3.f, 4.f, 5.f, 6.f, 7.f) };
+	const __m256i laneBit{ _mm256_setr_epi32(1, 2, 4, 8, 16, 32, 64, 128) };
+	const __m256 depth0{ _mm256_set1_ps(setup.depth[0]) };
+	const __m256 depth1{ _mm256_set1_ps(setup.depth[1]) };
+	const __m256 depth2{ _mm256_set1_ps(setup.depth[2]) };
+
+	alignas(32) float weightLanes[3][8]{};
+	alignas(32) float depthLanes[8]{};
+
+	for (int py{ minY }; py < maxY; ++py)
+	{
+		int64_t edgeSpan[3]{ edgeRow[0], edgeRow[1], edgeRow[2] };
+
+		for (int px{ minX }; px < maxX; px += 8)
+		{
+			const int validMask{ (1 << std::min(8, maxX - px)) - 1 };
+
+			int coverageMask{ validMask };
+			if (!isFullyCovered)
+			{
+				// Coverage: a lane is outside when the sign bit of any of its 3 edges is set
+				__m256i edgeOrLo{ _mm256_setzero_si256() };
+				__m256i edgeOrHi{ _mm256_setzero_si256() };
+				for (int idx = 0; idx < 3; ++idx)
+				{
+					const __m256i edgeBase{ _mm256_set1_epi64x(edgeSpan[idx]) };
+					edgeOrLo = _mm256_or_si256(edgeOrLo, _mm256_add_epi64(edgeBase, edgeLaneOffsetLo[idx]));
+					edgeOrHi = _mm256_or_si256(edgeOrHi, _mm256_add_epi64(edgeBase, edgeLaneOffsetHi[idx]));
+				}
+				const int outsideMask{ _mm256_movemask_pd(_mm256_castsi256_pd(edgeOrLo)) | (_mm256_movemask_pd(_mm256_castsi256_pd(edgeOrHi)) << 4) };
+				coverageMask &= ~outsideMask;
+			}
+
+			if (coverageMask != 0)
+			{
+				// Barycentric weights as float plane equations along the span
+				__m256 weights[3]{};
+				for (int idx = 0; idx < 3; ++idx)
+				{
+					const __m256 weightBase{ _mm256_set1_ps(float(edgeSpan[idx] - edges[idx].bias) * setup.invArea) };
+					weights[idx] = _mm256_add_ps(weightBase, _mm256_mul_ps(laneIdx, weightStepX[idx]));
+				}
+
+				const __m256 depth{ _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(weights[0], depth0), _mm256_mul_ps(weights[1], depth1)), _mm256_mul_ps(weights[2], depth2)) };
+				const __m256i depthKey{ EncodeDepthAVX2(depth) };
+
+				// Depth test, masked lanes are never read or written so spans may run past the bounding box
+				DepthType* pDepth{ reinterpret_cast<DepthType*>(m_pDepthBufferPixels) + GetPixelIndex(px, py) };
+				int passMask{ coverageMask };
+				if (isDepthTestRequired)
+				{
+					const __m256i coverageLanes{ _mm256_cmpeq_epi32(_mm256_and_si256(_mm256_set1_epi32(coverageMask), laneBit), laneBit) };
+					const __m256i storedDepth{ LoadDepthSpan(pDepth, coverageMask, coverageLanes) };
+					const __m256i depthPassed
+					{
+						depthTest == DepthTest::Equal ?
+						_mm256_cmpeq_epi32(depthKey, storedDepth) :
+						_mm256_cmpgt_epi32(storedDepth, depthKey)
+					};
+					passMask &= _mm256_movemask_ps(_mm256_castsi256_ps(depthPassed));
+				}
 
-	//Lock BackBuffer
-	SDL_LockSurface(m_pBackBuffer);
+				if (passMask != 0)
+				{
+					if (depthTest == DepthTest::Less)
+					{
+						const __m256i passLanes{ _mm256_cmpeq_epi32(_mm256_and_si256(_mm256_set1_epi32(passMask), laneBit), laneBit) };
+						StoreDepthSpan(pDepth, passMask, passLanes, depthKey);
+						isDepthWritten = true;
+					}
+
+					_mm256_store_ps(weightLanes[0], weights[0]);
+					_mm256_store_ps(weightLanes[1], weights[1]);
+					_mm256_store_ps(weightLanes[2], weights[2]);
+					_mm256_store_ps(depthLanes, depth);
+
+					// Shading is scalar code, leave the AVX state clean before calling it
+					_mm256_zeroupper();
+
+					// Only the surviving lanes get shaded
+					for (unsigned int lanes{ static_cast<unsigned int>(passMask) }; lanes != 0; lanes &= lanes - 1)
+					{
+						const int lane{ std::countr_zero(lanes) };
+						shadePixel(px + lane, py, Vector3{ weightLanes[0][lane], weightLanes[1][lane], weightLanes[2][lane] }, depthLanes[lane]);
+					}
+				}
+			}
 
-	//Solutions
-	//Solution_W1();
-	//Solution_W2_W3();
-	//Solution_W4();
-	Solution_W5();
-	
+			edgeSpan[0] += edgeStepSpan[0];
+			edgeSpan[1] += edgeStepSpan[1];
+			edgeSpan[2] += edgeStepSpan[2];
+		}
 
-	//@END
-	//Update SDL Surface
-	SDL_UnlockSurface(m_pBackBuffer);
-	SDL_BlitSurface(m_pBackBuffer, 0, m_pFrontBuffer, 0);
-	SDL_UpdateWindowSurface(m_pWindow);
+		edgeRow[0] += edgeStepY[0];
+		edgeRow[1] += edgeStepY[1];
+		edgeRow[2] += edgeStepY[2];
+	}
+
+	return isDepthWritten;
 }
 
-void Renderer::Solution_W5()
+template<typename DepthType>
+__m256i Renderer::LoadDepthSpan(const DepthType* pDepth, int laneMask, __m256i lanes) const
 {
-	//Projection Stage
-	m_pVehicleMesh->worldMatrix = Matrix::CreateRotationY(m_VehicleYaw);
-	VertexTransformationMatrix(m_pVehicleMesh);
-
+	if constexpr (sizeof(DepthType) == sizeof(uint32_t))
+	{
+		return _mm256_maskload_epi32(reinterpret_cast<const int*>(pDepth), lanes);
+	}
+	else if constexpr (sizeof(DepthType) == sizeof(Depth24))
+	{
+		// A full span is 24 bytes: bytes 0-15 feed the low half and bytes 12-23 the high half, each spreads 4 keys over 4 lanes
+		if (laneMask == 0xFF)
+		{
+			const __m128i lowBytes{ _mm_loadu_si128(reinterpret_cast<const __m128i*>(pDepth)) };
+			const __m128i highBytes{ _mm_alignr_epi8(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(reinterpret_cast<const uint8_t*>(pDepth) + 16)), lowBytes, 12) };
+			const __m256i unpackKeys{ _mm256_setr_epi8(0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11, -1, 0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11, -1) };
+			return _mm256_shuffle_epi8(_mm256_set_m128i(highBytes, lowBytes), unpackKeys);
+		}
 
-	for (size_t idx = 0; idx < m_pVehicleMesh->indices.size(); idx += 3)
+		alignas(32) uint32_t depthLanes[8]{};
+		for (unsigned int laneBits{ static_cast<unsigned int>(laneMask) }; laneBits != 0; laneBits &= laneBits - 1)
+		{
+			const int lane{ std::countr_zero(laneBits) };
+			depthLanes[lane] = pDepth[lane];
+		}
+		return _mm256_load_si256(reinterpret_cast<const __m256i*>(depthLanes));
+	}
+	else
 	{
-		std::vector<Vertex_Out> triangle{};
+		// There are no 16-bit masked loads, a span that is fully inside the rect is read in one go
+		if (laneMask == 0xFF)
+		{
+			return _mm256_cvtepu16_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i*>(pDepth)));
+		}
 
-		triangle.push_back(m_pVehicleMesh->vertices_out[m_pVehicleMesh->indices[idx + 0]]);
-		triangle.push_back(m_pVehicleMesh->vertices_out[m_pVehicleMesh->indices[idx + 1]]);
-		triangle.push_back(m_pVehicleMesh->vertices_out[m_pVehicleMesh->indices[idx + 2]]);
+		alignas(16) uint16_t depthLanes[8]{};
+		for (unsigned int laneBits{ static_cast<unsigned int>(laneMask) }; laneBits != 0; laneBits &= laneBits - 1)
+		{
+			const int lane{ std::countr_zero(laneBits) };
+			depthLanes[lane] = pDepth[lane];
+		}
+		return _mm256_cvtepu16_epi32(_mm_load_si128(reinterpret_cast<const __m128i*>(depthLanes)));
+	}
+}
 
-		// Optimisation Stage
-		if (IsFrustumCullingRequired(triangle))
+template<typename DepthType>
+void Renderer::StoreDepthSpan(DepthType* pDepth, int laneMask, __m256i lanes, __m256i depthKey) const
+{
+	if constexpr (sizeof(DepthType) == sizeof(uint32_t))
+	{
+		_mm256_maskstore_epi32(reinterpret_cast<int*>(pDepth), lanes, depthKey);
+	}
+	else if constexpr (sizeof(DepthType) == sizeof(Depth24))
+	{
+		// Inverse of the load: both halves drop the top byte of every key, then they are written back to back
+		if (laneMask == 0xFF)
 		{
-			continue;
+			const __m256i packKeys{ _mm256_setr_epi8(0, 1, 2, 4, 5, 6, 8, 9, 10, 12, 13, 14, -1, -1, -1, -1, 0, 1, 2, 4, 5, 6, 8, 9, 10, 12, 13, 14, -1, -1, -1, -1) };
+			const __m256i packedKey{ _mm256_shuffle_epi8(depthKey, packKeys) };
+			const __m128i lowBytes{ _mm256_castsi256_si128(packedKey) };
+			const __m128i highBytes{ _mm256_extracti128_si256(packedKey, 1) };
+			_mm_storeu_si128(reinterpret_cast<__m128i*>(pDepth), _mm_or_si128(lowBytes, _mm_slli_si128(highBytes, 12)));
+			_mm_storel_epi64(reinterpret_cast<__m128i*>(reinterpret_cast<uint8_t*>(pDepth) + 16), _mm_srli_si128(highBytes, 4));
+			return;
 		}
 
-		// NDC -> Screen Space Coordinates
-		for (Vertex_Out& vertex : triangle)
+		alignas(32) uint32_t depthLanes[8]{};
+		_mm256_store_si256(reinterpret_cast<__m256i*>(depthLanes), depthKey);
+		for (unsigned int laneBits{ static_cast<unsigned int>(laneMask) }; laneBits != 0; laneBits &= laneBits - 1)
+		{
+			const int lane{ std::countr_zero(laneBits) };
+			pDepth[lane] = Depth24(depthLanes[lane]);
+		}
+	}
+	else
+	{
+		// 16-bit keys never use the upper half of a lane, so packing with unsigned saturation is exact
+		const __m128i packedKey{ _mm_packus_epi32(_mm256_castsi256_si128(depthKey), _mm256_extracti128_si256(depthKey, 1)) };
+		if (laneMask == 0xFF)
 		{
-			vertex.position.x = ((1 + vertex.position.x) / 2) * m_Width;
-			vertex.position.y = ((1 - vertex.position.y) / 2) * m_Height;
+			_mm_storeu_si128(reinterpret_cast<__m128i*>(pDepth), packedKey);
+			return;
 		}
 
-		// Rasterization Stage
-		RenderTriangle_W5(triangle);
+		alignas(16) uint16_t depthLanes[8]{};
+		_mm_store_si128(reinterpret_cast<__m128i*>(depthLanes), packedKey);
+		for (unsigned int laneBits{ static_cast<unsigned int>(laneMask) }; laneBits != 0; laneBits &= laneBits - 1)
+		{
+			const int lane{ std::countr_zero(laneBits) };
+			pDepth[lane] = depthLanes[lane];
+		}
 	}
 }
 
-void Renderer::VertexTransformationMatrix(Mesh* Mesh)
+bool Renderer::SetupTileTriangle(const Vector3& v0, const Vector3& v1, const Vector3& v2, const Tile& tile, DepthTest depthTest, RasterSetup& setup, Int2& min, Int2& max) const
 {
-	/*
-	Optimizations
-	* Declare and define vertex_out outside the loop. Right now the destructor is being called at the end of each loop
-	* Don't pushback the values. Instead reserve and resize the vertices_out vector and fill in the values at idx
-	*/
+	Vector2 topLeft{};
+	Vector2 botRight{};
+	FindBoundingBoxCorners(topLeft, botRight, v0.GetXY(), v1.GetXY(), v2.GetXY());
 
-	Matrix WorldViewProjectionMatrix
-	{
-		Mesh->worldMatrix * m_Camera.invViewMatrix * m_Camera.ProjectionMatrix
-	};
+	// Only rasterize the part of the bounding box that lies inside the tile
+	min.x = std::max(int(topLeft.x), tile.minX);
+	min.y = std::max(int(topLeft.y), tile.minY);
+	max.x = std::min(int(botRight.x), tile.maxX);
+	max.y = std::min(int(botRight.y), tile.maxY);
 
-	for (size_t idx = 0; idx < Mesh->vertices.size(); ++idx)
+	// Hierarchical Z: reject the whole triangle before any setup work
+	const uint32_t nearestDepth{ std::min(std::min(EncodeDepth(v0.z), EncodeDepth(v1.z)), EncodeDepth(v2.z)) };
+	if (IsOccluded(nearestDepth, min.x, min.y, max.x, max.y, depthTest))
 	{
-		Vertex_Out vertex_out{ Vertex_Out(
-							   {Mesh->vertices[idx].position.x,
-								Mesh->vertices[idx].position.y,
-								Mesh->vertices[idx].position.z,
-								1}
-								,
-								Mesh->vertices[idx].uv
-								,
-								Mesh->vertices[idx].color,
-								Mesh->vertices[idx].normal,
-								Mesh->vertices[idx].tangent) };
+		return false;
+	}
 
-		// Position Transformation To NDC
-		vertex_out.position = WorldViewProjectionMatrix.TransformPoint(vertex_out.position);
+	if (!SetupRasterTriangle(v0, v1, v2, setup))
+	{
+		return false;
+	}
 
-		// Perspective Divide
-		vertex_out.position.x /= vertex_out.position.w;
-		vertex_out.position.y /= vertex_out.position.w;
-		vertex_out.position.z /= vertex_out.position.w;
+	// Small triangles: find the covered pixels up front, one that falls between pixel centers ends here
+	if (max.x - min.x <= SMALL_TRIANGLE_SIZE && max.y - min.y <= SMALL_TRIANGLE_SIZE)
+	{
+		setup.smallCoverageMask = GetSmallTriangleCoverage(setup, min.x, min.y, max.x, max.y);
+		return setup.smallCoverageMask != 0;
+	}
 
-		// Normal & Tangent Transformation To World Space
-		vertex_out.normal = Mesh->worldMatrix.TransformVector(vertex_out.normal);
-		vertex_out.tangent = Mesh->worldMatrix.TransformVector(vertex_out.tangent);
-		vertex_out.normal.Normalize();
-		vertex_out.tangent.Normalize();
+	return true;
+}
 
-		// Create ViewDirection
-		vertex_out.viewDirection = Mesh->worldMatrix.TransformVector(Mesh->vertices[idx].position) - m_Camera.origin;
+uint32_t Renderer::RenderTriangle_W5(const TriangleRecord& triangle, uint32_t triangleIdx, const Tile& tile) const
+{
+	// After a depth pre-pass only the fragments that produced the stored depth get shaded
+	const DepthTest depthTest{ m_IsDepthPrePassEnabled ? DepthTest::Equal : DepthTest::Less };
+
+	// Triangle Setup
+	RasterSetup setup{};
+	Int2 min{};
+	Int2 max{};
+	if (!SetupTileTriangle(triangle.positions[0].GetXYZ(), triangle.positions[1].GetXYZ(), triangle.positions[2].GetXYZ(), tile, depthTest, setup, min, max))
+	{
+		return 0;
+	}
 
-		// NDC Output
-		Mesh->vertices_out[idx] = vertex_out;
+	uint32_t nrDepthPassedFragments{};
+	if (m_IsVisibilityBufferEnabled)
+	{
+		// Visibility pass: only remember which triangle won the depth test and where, shading happens once per pixel afterwards
+		RasterizeTriangle(setup, min.x, min.y, max.x, max.y, depthTest, [&](int px, int py, const Vector3& weights, float)
+			{
+				m_pVisibilityBuffer[GetPixelIndex(px, py)] = VisibilityEntry{ triangleIdx, weights.x, weights.y };
+				++nrDepthPassedFragments;
+			});
+		return nrDepthPassedFragments;
 	}
 
+	const AttributePlanes& attributePlanes{ m_AttributePlanes[triangleIdx] };
+	RasterizeTriangle(setup, min.x, min.y, max.x, max.y, depthTest, [&](int px, int py, const Vector3& weights, float)
+		{
+			ShadePixel_W5(px, py, attributePlanes, weights);
+			++nrDepthPassedFragments;
+		});
+	return nrDepthPassedFragments;
 }
 
-
-void Renderer::FindBoundingBoxCorners(Vector2& topLeft, Vector2& botRight,const std::vector<Vertex_Out>& triangle) const
+void Renderer::RenderTriangleDepth(const std::array<Vector3, 3>& triangle, const Tile& tile) const
 {
-	topLeft.x = std::min(std::min(triangle[0].position.x, triangle[1].position.x), triangle[2].position.x);
-	topLeft.x = Clamp(topLeft.x, 0.f, float(m_Width - 1));
-	topLeft.y = std::min(std::min(triangle[0].position.y, triangle[1].position.y), triangle[2].position.y);
-	topLeft.y = Clamp(topLeft.y, 0.f, float(m_Height - 1));
+	RasterSetup setup{};
+	Int2 min{};
+	Int2 max{};
+	if (!SetupTileTriangle(triangle[0], triangle[1], triangle[2], tile, DepthTest::Less, setup, min, max))
+	{
+		return;
+	}
 
-	botRight.x = std::max(std::max(triangle[0].position.x, triangle[1].position.x), triangle[2].position.x);
-	botRight.x = Clamp(botRight.x, 0.f, float(m_Width - 1));
-	botRight.x = std::ceil(botRight.x);
+	// The kernel writes depth and keeps the hierarchical Z up to date, there is nothing to shade
+	RasterizeTriangle(setup, min.x, min.y, max.x, max.y, DepthTest::Less, [](int, int, const Vector3&, float) {});
+}
 
-	botRight.y = std::max(std::max(triangle[0].position.y, triangle[1].position.y), triangle[2].position.y);
-	botRight.y = Clamp(botRight.y, 0.f, float(m_Height - 1));
-	botRight.y = std::ceil(botRight.y);
+void Renderer::ShadeVisibilityBuffer(const Tile& tile) const
+{
+	for (int py{ tile.minY }; py < tile.maxY; ++py)
+	{
+		for (int px{ tile.minX }; px < tile.maxX; ++px)
+		{
+			// Pixels no triangle won keep the clear color
+			const VisibilityEntry& entry{ m_pVisibilityBuffer[GetPixelIndex(px, py)] };
+			if (entry.triangleIdx == UINT32_MAX)
+			{
+				continue;
+			}
 
+			const Vector3 weights{ entry.weight0, entry.weight1, 1.f - entry.weight0 - entry.weight1 };
 
+			ShadePixel_W5(px, py, m_AttributePlanes[entry.triangleIdx], weights);
+		}
+	}
 }
 
-void Renderer::RenderTriangle_W5(std::vector<Vertex_Out>& triangle) const
+bool Renderer::IsTriangleShaded(const TriangleRecord& triangle) const
 {
-	const Vector2 v0{ triangle[0].position.x, triangle[0].position.y };
-	const Vector2 v1{ triangle[1].position.x, triangle[1].position.y };
-	const Vector2 v2{ triangle[2].position.x, triangle[2].position.y };
+	// Conservative version of the rejections in SetupTileTriangle over the whole bounding box
+	// If it fails here it fails in every tile the triangle is binned to, so its planes are never read
+	const Vector3 v0{ triangle.positions[0].GetXYZ() };
+	const Vector3 v1{ triangle.positions[1].GetXYZ() };
+	const Vector3 v2{ triangle.positions[2].GetXYZ() };
 
 	Vector2 topLeft{};
 	Vector2 botRight{};
-	FindBoundingBoxCorners(topLeft, botRight, triangle);
-
+	FindBoundingBoxCorners(topLeft, botRight, v0.GetXY(), v1.GetXY(), v2.GetXY());
+	const Int2 min{ int(topLeft.x), int(topLeft.y) };
+	const Int2 max{ int(botRight.x), int(botRight.y) };
+	if (min.x >= max.x || min.y >= max.y)
+	{
+		return false;
+	}
 
-	for (int py{ int(topLeft.y) }; py < int(botRight.y); ++py)
+	// Only the pre-pass leaves this frame's depth in every tile a triangle is binned to, otherwise the hierarchical Z is stale
+	if (m_IsDepthPrePassEnabled)
 	{
-		for (int px{ int(topLeft.x) }; px < int(botRight.x); ++px)
+		const uint32_t nearestDepth{ std::min(std::min(EncodeDepth(v0.z), EncodeDepth(v1.z)), EncodeDepth(v2.z)) };
+		if (IsOccluded(nearestDepth, min.x, min.y, max.x, max.y, DepthTest::Equal))
 		{
-			Vector3 weights{};
-			ColorRGB finalColor{};
-			const Vector2 pixel_ssc{ float(px) + 0.5f , float(py) + 0.5f };
+			return false;
+		}
+	}
+
+	RasterSetup setup{};
+	if (!SetupRasterTriangle(v0, v1, v2, setup))
+	{
+		return false;
+	}
+
+	if (max.x - min.x <= SMALL_TRIANGLE_SIZE && max.y - min.y <= SMALL_TRIANGLE_SIZE)
+	{
+		return GetSmallTriangleCoverage(setup, min.x, min.y, max.x, max.y) != 0;
+	}
 
-			const float area{ Vector2::Cross(Vector2(v1, v2), Vector2(v1, v0)) };
+	return true;
+}
+
+void Renderer::SetupAttributePlanes(const TriangleRecord& triangle, AttributePlanes& attributePlanes) const
+{
+	for (int vertexIdx = 0; vertexIdx < 3; ++vertexIdx)
+	{
+		const std::array<float, NR_ATTRIBUTE_CHANNELS - 1>& attributes{ triangle.attributes[vertexIdx] };
+		const float invW{ 1 / triangle.positions[vertexIdx].w };
 
-			weights.x = CalculateWeights(v1, v2, pixel_ssc, area);
-			weights.y = CalculateWeights(v2, v0, pixel_ssc, area);
-			weights.z = CalculateWeights(v0, v1, pixel_ssc, area);
+		// Perspective correct interpolation: everything is interpolated divided by w, 1/w itself is channel 0
+		float channels[NR_ATTRIBUTE_CHANNELS]{ invW };
+		for (int channelIdx = 1; channelIdx < NR_ATTRIBUTE_CHANNELS; ++channelIdx)
+		{
+			channels[channelIdx] = attributes[channelIdx - 1] * invW;
+		}
 
-			if (IsPointInTriangle(weights))
+		for (int channelIdx = 0; channelIdx < NR_ATTRIBUTE_CHANNELS; ++channelIdx)
+		{
+			switch (vertexIdx)
 			{
-				float zBufferValue{ 1 / ((weights.x / triangle[0].position.z) + (weights.y / triangle[1].position.z) + (weights.z / triangle[2].position.z)) };
+			case 0: attributePlanes.origin[channelIdx] = channels[channelIdx]; break;
+			case 1: attributePlanes.gradient1[channelIdx] = channels[channelIdx] - attributePlanes.origin[channelIdx]; break;
+			default: attributePlanes.gradient2[channelIdx] = channels[channelIdx] - attributePlanes.origin[channelIdx]; break;
+			}
+		}
+	}
+}
 
-				if (zBufferValue < m_pDepthBufferPixels[px + py * m_Width])
-				{
-					m_pDepthBufferPixels[px + (py * m_Width)] = zBufferValue;
+void Renderer::ShadePixel_W5(int px, int py, const AttributePlanes& attributePlanes, const Vector3& weights) const
+{
+	ColorRGB finalColor{};
 
-					const float wInterpolated{ 1 / ((weights.x / triangle[0].position.w) + (weights.y / triangle[1].position.w) + (weights.z / triangle[2].position.w)) };
+	// Two multiply-adds per channel, the weight of vertex 0 is implied
+	float channels[NR_ATTRIBUTE_CHANNELS]{};
+	for (int channelIdx = 0; channelIdx < NR_ATTRIBUTE_CHANNELS; ++channelIdx)
+	{
+		channels[channelIdx] = attributePlanes.origin[channelIdx] + (weights.y * attributePlanes.gradient1[channelIdx]) + (weights.z * attributePlanes.gradient2[channelIdx]);
+	}
 
-					Vector2 uvInterpolated{ wInterpolated   *  (weights.x * (triangle[0].uv / triangle[0].position.w) +
-																weights.y * (triangle[1].uv / triangle[1].position.w) +
-																weights.z * (triangle[2].uv / triangle[2].position.w)) };
+	const float wInterpolated{ 1 / channels[0] };
 
-					Vertex_Out interpolatedData{};
-					interpolatedData.uv = uvInterpolated;
-					interpolatedData.color = m_pTextureVehicle->Sample(uvInterpolated);
-					interpolatedData.normal = ((triangle[0].normal / triangle[0].position.w) * weights.x +
-											   (triangle[1].normal / triangle[1].position.w) * weights.y +
-											   (triangle[2].normal / triangle[2].position.w) * weights.z) * wInterpolated;
-					interpolatedData.normal.Normalize();
+	Vector2 uvInterpolated{ channels[1] * wInterpolated, channels[2] * wInterpolated };
 
-					interpolatedData.tangent =  ((triangle[0].tangent / triangle[0].position.w) * weights.x +
-												 (triangle[1].tangent / triangle[1].position.w) * weights.y +
-												 (triangle[2].tangent / triangle[2].position.w) * weights.z) * wInterpolated;
-					interpolatedData.tangent.Normalize();
+	Vertex_Out interpolatedData{};
+	interpolatedData.uv = uvInterpolated;
+	interpolatedData.color = m_pTextureVehicle->Sample(uvInterpolated);
 
-					interpolatedData.viewDirection =   ((triangle[0].viewDirection / triangle[0].position.w) * weights.x +
-														(triangle[1].viewDirection / triangle[1].position.w) * weights.y +
-														(triangle[2].viewDirection / triangle[2].position.w) * weights.z) * wInterpolated;
-					interpolatedData.viewDirection.Normalize();
+	// Only the direction matters for these, so the multiplication by w is folded into Normalize
+	interpolatedData.normal = Vector3{ channels[3], channels[4], channels[5] };
+	interpolatedData.normal.Normalize();
 
-					finalColor = PixelShading(interpolatedData);
+	interpolatedData.tangent = Vector3{ channels[6], channels[7], channels[8] };
+	interpolatedData.tangent.Normalize();
 
+	interpolatedData.viewDirection = Vector3{ channels[9], channels[10], channels[11] };
+	interpolatedData.viewDirection.Normalize();
 
+	finalColor = PixelShading(interpolatedData);
 
-					//finalColor = m_pTextureVehicle->Sample(uvInterpolated);
-					finalColor.MaxToOne();
 
-					m_pBackBufferPixels[px + (py * m_Width)] = SDL_MapRGB(m_pBackBuffer->format,
-						static_cast<uint8_t>(finalColor.r * 255),
-						static_cast<uint8_t>(finalColor.g * 255),
-						static_cast<uint8_t>(finalColor.b * 255));
-				}
+
+	//finalColor = m_pTextureVehicle->Sample(uvInterpolated);
+	WritePixel(px, py, finalColor);
+}
+
+void Renderer::WritePixel(int px, int py, const ColorRGB& color) const
+{
+	// Staged as float planes, ResolveTile normalizes and packs the whole tile at once
+	const int pixelIdx{ GetPixelIndex(px, py) };
+	m_pColorBuffer[pixelIdx] = color.r;
+	m_pColorBuffer[pixelIdx + m_NrTiledPixels] = color.g;
+	m_pColorBuffer[pixelIdx + (2 * m_NrTiledPixels)] = color.b;
+
+	m_pShadedPixelMask[(py * m_NrTilesX) + (px / TILE_SIZE)] |= uint64_t(1) << (px % TILE_SIZE);
+}
+
+uint32_t Renderer::PackColor(ColorRGB color) const
+{
+	color.MaxToOne();
+
+	return	(uint32_t(static_cast<uint8_t>(std::max(color.r, 0.f) * 255)) << m_RedShift) |
+			(uint32_t(static_cast<uint8_t>(std::max(color.g, 0.f) * 255)) << m_GreenShift) |
+			(uint32_t(static_cast<uint8_t>(std::max(color.b, 0.f) * 255)) << m_BlueShift) |
+			m_AlphaMask;
+}
+
+uint32_t Renderer::ResolveTile(const Tile& tile) const
+{
+	// Detile: the staged colors are read in the tiled layout, the back buffer is written row-major
+	const float* pRed{ m_pColorBuffer };
+	const float* pGreen{ m_pColorBuffer + m_NrTiledPixels };
+	const float* pBlue{ m_pColorBuffer + (2 * m_NrTiledPixels) };
+
+	uint32_t nrResolvedPixels{};
+	for (int py{ tile.minY }; py < tile.maxY; ++py)
+	{
+		uint64_t& shadedMask{ m_pShadedPixelMask[(py * m_NrTilesX) + (tile.minX / TILE_SIZE)] };
+		if (shadedMask == 0)
+		{
+			continue;
+		}
+		nrResolvedPixels += uint32_t(std::popcount(shadedMask));
+
+		if (!m_IsAVX2Supported)
+		{
+			for (uint64_t pixels{ shadedMask }; pixels != 0; pixels &= pixels - 1)
+			{
+				const int px{ tile.minX + std::countr_zero(pixels) };
+				const int pixelIdx{ GetPixelIndex(px, py) };
+				m_pBackBufferPixels[px + (py * m_Width)] = PackColor(ColorRGB{ pRed[pixelIdx], pGreen[pixelIdx], pBlue[pixelIdx] });
+			}
+
+			shadedMask = 0;
+			continue;
+		}
+
+		const __m256i laneBit{ _mm256_setr_epi32(1, 2, 4, 8, 16, 32, 64, 128) };
+		const __m256 zero{ _mm256_setzero_ps() };
+		const __m256 one{ _mm256_set1_ps(1.f) };
+		const __m256 maxByte{ _mm256_set1_ps(255.f) };
+
+		for (int x{ 0 }; x < tile.maxX - tile.minX; x += 8)
+		{
+			const int laneMask{ int((shadedMask >> x) & 0xFF) };
+			if (laneMask == 0)
+			{
+				continue;
 			}
+
+			// Only shaded lanes are read or written, the rest of the span keeps the clear color
+			const __m256i lanes{ _mm256_cmpeq_epi32(_mm256_and_si256(_mm256_set1_epi32(laneMask), laneBit), laneBit) };
+			const int pixelIdx{ GetPixelIndex(tile.minX + x, py) };
+			__m256 red{ _mm256_maskload_ps(pRed + pixelIdx, lanes) };
+			__m256 green{ _mm256_maskload_ps(pGreen + pixelIdx, lanes) };
+			__m256 blue{ _mm256_maskload_ps(pBlue + pixelIdx, lanes) };
+
+			// ColorRGB::MaxToOne, dividing by 1 leaves colors that are already in range untouched
+			const __m256 maxValue{ _mm256_max_ps(_mm256_max_ps(red, green), _mm256_max_ps(blue, one)) };
+			red = _mm256_max_ps(_mm256_div_ps(red, maxValue), zero);
+			green = _mm256_max_ps(_mm256_div_ps(green, maxValue), zero);
+			blue = _mm256_max_ps(_mm256_div_ps(blue, maxValue), zero);
+
+			// Truncating conversion, the same as the static_cast to uint8_t
+			const __m256i packed
+			{
+				_mm256_or_si256(
+					_mm256_or_si256(
+						_mm256_sll_epi32(_mm256_cvttps_epi32(_mm256_mul_ps(red, maxByte)), m_RedShiftCount),
+						_mm256_sll_epi32(_mm256_cvttps_epi32(_mm256_mul_ps(green, maxByte)), m_GreenShiftCount)),
+					_mm256_or_si256(
+						_mm256_sll_epi32(_mm256_cvttps_epi32(_mm256_mul_ps(blue, maxByte)), m_BlueShiftCount),
+						_mm256_set1_epi32(int(m_AlphaMask))))
+			};
+			_mm256_maskstore_epi32(reinterpret_cast<int*>(m_pBackBufferPixels + tile.minX + x + (py * m_Width)), lanes, packed);
 		}
+
+		shadedMask = 0;
 	}
+
+	_mm256_zeroupper();
+	return nrResolvedPixels;
 }
 
 ColorRGB Renderer::PixelShading(const Vertex_Out& v) const 
@@ -315,33 +2361,118 @@ ColorRGB Renderer::PixelShading(const Vertex_Out& v) const
 	return shading;
 }
 
-bool Renderer::IsFrustumCullingRequired(std::vector<Vertex_Out>& triangle) const
+bool Renderer::IsFrustumCullingRequired(const uint16_t clipCodes[3]) const
 {
-	for (Vertex_Out& vertex : triangle)
+	// Only a triangle with all three vertices outside the same plane is guaranteed to be invisible
+	return (clipCodes[0] & clipCodes[1] & clipCodes[2] & FRUSTUM_MASK) != 0;
+}
+
+bool Renderer::IsFaceCullingRequired(const Vector2& v0, const Vector2& v1, const Vector2& v2, CullMode cullMode) const
+{
+	// Screen space y points down, so a clockwise triangle in view has a positive signed area
+	const float signedArea{ Vector2::Cross(v1 - v0, v2 - v0) };
+
+	switch (cullMode)
+	{
+	case CullMode::Back:	return signedArea < 0.f;
+	case CullMode::Front:	return signedArea > 0.f;
+	default:				return false;
+	}
+}
+
+uint16_t Renderer::GetClipCode(const Vector4& position) const
+{
+	uint16_t clipCode{};
+	for (int plane = 0; plane < NR_CLIP_PLANES; ++plane)
 	{
-		if (vertex.position.x < -1.f || vertex.position.x > 1.f ||
-			vertex.position.y < -1.f || vertex.position.y > 1.f ||
-			vertex.position.z <  0.f || vertex.position.z > 1.f )
+		if (GetClipDistance(position, plane) < 0.f)
 		{
-			return true;
+			clipCode |= uint16_t(1 << plane);
 		}
 	}
 
-	return false;
+	return clipCode;
 }
 
-bool Renderer::IsPointInTriangle(const Vector3& weights) const
+float Renderer::GetClipDistance(const Vector4& position, int plane) const
 {
-	if ((weights.x > 0) && (weights.y > 0) && (weights.z > 0))
+	// Positive inside, the planes are in clip space so this works for vertices behind the camera as well
+	switch (plane)
 	{
-		return true;
+	case 0: return position.w + position.x;
+	case 1: return position.w - position.x;
+	case 2: return position.w + position.y;
+	case 3: return position.w - position.y;
+	case 4: return m_Camera.isReversedZ ? position.w - position.z : position.z;
+	case 5: return m_Camera.isReversedZ ? position.z : position.w - position.z;
+	case 6: return (GUARD_BAND * position.w) + position.x;
+	case 7: return (GUARD_BAND * position.w) - position.x;
+	case 8: return (GUARD_BAND * position.w) + position.y;
+	default: return (GUARD_BAND * position.w) - position.y;
 	}
+}
+
+Vector4 Renderer::LerpClipVertex(const Vector4& from, const Vector4& to, float factor) const
+{
+	return from + ((to - from) * factor);
+}
+
+Vertex_Out Renderer::LerpClipVertex(const Vertex_Out& from, const Vertex_Out& to, float factor) const
+{
+	// Clip space is linear, so every attribute is interpolated with the same factor as the position
+	Vertex_Out vertex{};
+	vertex.position = LerpClipVertex(from.position, to.position, factor);
+	vertex.color = ColorRGB::Lerp(from.color, to.color, factor);
+	vertex.uv = from.uv + ((to.uv - from.uv) * factor);
+	vertex.normal = from.normal + ((to.normal - from.normal) * factor);
+	vertex.tangent = from.tangent + ((to.tangent - from.tangent) * factor);
+	vertex.viewDirection = from.viewDirection + ((to.viewDirection - from.viewDirection) * factor);
+	return vertex;
+}
+
+template<typename ClipVertex>
+void Renderer::ClipTriangle(const std::array<ClipVertex, 3>& triangle, uint16_t clipPlanes, std::vector<ClipVertex>& polygon, std::vector<ClipVertex>& scratch) const
+{
+	polygon.assign(triangle.begin(), triangle.end());
+
+	// Sutherland-Hodgman, one plane at a time
+	for (int plane = 0; plane < NR_CLIP_PLANES && polygon.size() >= 3; ++plane)
+	{
+		if ((clipPlanes & (1 << plane)) == 0)
+		{
+			continue;
+		}
+
+		scratch.clear();
+		for (size_t idx = 0; idx < polygon.size(); ++idx)
+		{
+			const ClipVertex& current{ polygon[idx] };
+			const ClipVertex& next{ polygon[(idx + 1) % polygon.size()] };
+			const float currentDistance{ GetClipDistance(GetClipPosition(current), plane) };
+			const float nextDistance{ GetClipDistance(GetClipPosition(next), plane) };
+
+			if (currentDistance >= 0.f)
+			{
+				scratch.push_back(current);
+			}
+
+			// Always interpolate from the inside vertex, so a shared edge gets clipped to the same point from both sides
+			if ((currentDistance >= 0.f) != (nextDistance >= 0.f))
+			{
+				scratch.push_back(currentDistance >= 0.f ?
+					LerpClipVertex(current, next, currentDistance / (currentDistance - nextDistance)) :
+					LerpClipVertex(next, current, nextDistance / (nextDistance - currentDistance)));
+			}
+		}
 
-	return false;
+		polygon.swap(scratch);
+	}
 }
 
 void Renderer::Solution_W1()
 {
+	ClearAllTiles();
+
 	std::vector<Vertex> vertices_world
 	{
 		//triangle1
@@ -375,6 +2506,8 @@ void Renderer::Solution_W1()
 
 void Renderer::Solution_W2_W3()
 {
+	ClearAllTiles();
+
 	std::vector<Mesh> meshWorld
 	{
 		Mesh
@@ -486,6 +2619,8 @@ void Renderer::Solution_W2_W3()
 
 //void Renderer::Solution_W4()
 //{
+//	ClearAllTiles();
+//
 //	// Input
 //	std::vector<Mesh> meshWorldStrip
 //	{
@@ -583,60 +2718,48 @@ void Renderer::RenderTriangle_W3(const std::vector<Vertex>& triangleScreenSpace)
 	//triangle[2].position.x = ((1 + triangle[2].position.x) / 2) * m_Width;
 	//triangle[2].position.y = ((1 - triangle[2].position.y) / 2) * m_Height;
 
-	const Vector2 v0{ triangleScreenSpace[0].position.x, triangleScreenSpace[0].position.y };
-	const Vector2 v1{ triangleScreenSpace[1].position.x, triangleScreenSpace[1].position.y };
-	const Vector2 v2{ triangleScreenSpace[2].position.x, triangleScreenSpace[2].position.y };
+	const Vector3& v0{ triangleScreenSpace[0].position };
+	const Vector3& v1{ triangleScreenSpace[1].position };
+	const Vector3& v2{ triangleScreenSpace[2].position };
 
-	Vector2 topLeft{std::min(std::min(triangleScreenSpace[0].position.x,triangleScreenSpace[1].position.x), triangleScreenSpace[2].position.x),
-					std::min(std::min(triangleScreenSpace[0].position.y,triangleScreenSpace[1].position.y), triangleScreenSpace[2].position.y) };
+	// The depth formats encode NDC depth, the W1-W3 vertices only carry view space depth
+	RasterSetup setup{};
+	if (!SetupRasterTriangle({ v0.x, v0.y, ViewToNDCDepth(v0.z) }, { v1.x, v1.y, ViewToNDCDepth(v1.z) }, { v2.x, v2.y, ViewToNDCDepth(v2.z) }, setup))
+	{
+		return;
+	}
 
-	Vector2 bottomRight{std::max(std::max(triangleScreenSpace[0].position.x,triangleScreenSpace[1].position.x), triangleScreenSpace[2].position.x),
-						std::max(std::max(triangleScreenSpace[0].position.y,triangleScreenSpace[1].position.y), triangleScreenSpace[2].position.y) };
+	// The W3 vertices carry view space depth, the perspective correct uv needs its reciprocal
+	const std::array<float, 3> invZ{ 1 / v0.z, 1 / v1.z, 1 / v2.z };
 
-	topLeft.x = Clamp(topLeft.x, 0.f, float(m_Width - 1));
-	topLeft.y = Clamp(topLeft.y, 0.f, float(m_Height - 1));
-	bottomRight.x = Clamp(bottomRight.x, 0.f, float(m_Width - 1));
-	bottomRight.y = Clamp(bottomRight.y, 0.f, float(m_Height - 1));
+	Vector2 topLeft{};
+	Vector2 bottomRight{};
+	FindBoundingBoxCorners(topLeft, bottomRight, v0.GetXY(), v1.GetXY(), v2.GetXY());
 
-	for (int px{ int(topLeft.x) }; px < int(bottomRight.x); ++px)
-	{
-		for (int py{ int(topLeft.y) }; py < int(bottomRight.y); ++py)
+	RasterizeTriangle(setup, int(topLeft.x), int(topLeft.y), int(bottomRight.x), int(bottomRight.y), DepthTest::Less, [&](int px, int py, const Vector3& weights, float)
 		{
-			Vector3 weights{};
 			ColorRGB finalColor{};
-			const Vector2 pixel_ssc{ float(px) + 0.5f , float(py) + 0.5f };
-
-			const float area{ Vector2::Cross(Vector2(v1, v2), Vector2(v1, v0)) };
 
-			weights.x = CalculateWeights(v1, v2, pixel_ssc, area);
-			weights.y = CalculateWeights(v2, v0, pixel_ssc, area);
-			weights.z = CalculateWeights(v0, v1, pixel_ssc, area);
+			const float pixelDepth{ 1 / ((weights.x * invZ[0]) + (weights.y * invZ[1]) + (weights.z * invZ[2])) };
 
-			//const Vector3 point = triangleScreenSpace[0].position * weights.x + triangleScreenSpace[1].position * weights.y + triangleScreenSpace[2].position * weights.z; // previous pixelDepth version
-			const float pixelDepth{ 1 / (weights.x * (1 / triangleScreenSpace[0].position.z) + weights.y * (1 / triangleScreenSpace[1].position.z) + weights.z * (1 / triangleScreenSpace[2].position.z)) };
-			if (IsPointInTriangle(weights))
-			{
-				if (pixelDepth < m_pDepthBufferPixels[px + py * m_Width])
-				{
-					m_pDepthBufferPixels[py * m_Width + px] = pixelDepth;
+			//finalColor = triangleScreenSpace[0].color * weights.x + triangleScreenSpace[1].color * weights.y + triangleScreenSpace[2].color * weights.z;
+			//finalColor.MaxToOne();
 
-					//finalColor = triangleScreenSpace[0].color * weights.x + triangleScreenSpace[1].color * weights.y + triangleScreenSpace[2].color * weights.z;
-					//finalColor.MaxToOne();
+			Vector2 uvInterpolated{ pixelDepth * (	weights.x * (triangleScreenSpace[0].uv * invZ[0]) + 
+													weights.y * (triangleScreenSpace[1].uv * invZ[1]) + 
+													weights.z * (triangleScreenSpace[2].uv * invZ[2]))};
+			finalColor = m_pTextureUVGrid->Sample(uvInterpolated);
 
-					Vector2 uvInterpolated{ pixelDepth * (	weights.x * (triangleScreenSpace[0].uv / triangleScreenSpace[0].position.z) + 
-															weights.y * (triangleScreenSpace[1].uv / triangleScreenSpace[1].position.z) + 
-															weights.z * (triangleScreenSpace[2].uv / triangleScreenSpace[2].position.z))};
-					finalColor = m_pTextureUVGrid->Sample(uvInterpolated);
-					finalColor.MaxToOne();
+			// Straight to the back buffer, W1-W4 don't stage colors per tile
+			m_pBackBufferPixels[px + (py * m_Width)] = PackColor(finalColor);
+		});
+}
 
-					m_pBackBufferPixels[px + (py * m_Width)] = SDL_MapRGB(m_pBackBuffer->format,
-						static_cast<uint8_t>(finalColor.r * 255),
-						static_cast<uint8_t>(finalColor.g * 255),
-						static_cast<uint8_t>(finalColor.b * 255));
-				}
-			}
-		}
-	}
+float Renderer::ViewToNDCDepth(float viewDepth) const
+{
+	// Same projection as the W5 path, so every depth format and reversed-Z see the depth they expect
+	const Vector4 clipPosition{ m_Camera.ProjectionMatrix.TransformPoint(Vector4{ 0.f, 0.f, viewDepth, 1.f }) };
+	return clipPosition.z / clipPosition.w;
 }
 
 void Renderer::RenderTriangle_W4(std::vector<Vertex_Out>& triangle) const
@@ -648,62 +2771,35 @@ void Renderer::RenderTriangle_W4(std::vector<Vertex_Out>& triangle) const
 		vertex.position.y = ((1 - vertex.position.y) / 2) * m_Height;
 	}
 
-	const Vector2 v0{ triangle[0].position.x, triangle[0].position.y };
-	const Vector2 v1{ triangle[1].position.x, triangle[1].position.y };
-	const Vector2 v2{ triangle[2].position.x, triangle[2].position.y };
+	const Vector3 v0{ triangle[0].position.GetXYZ() };
+	const Vector3 v1{ triangle[1].position.GetXYZ() };
+	const Vector3 v2{ triangle[2].position.GetXYZ() };
 
-	Vector2 topLeft{	std::min(std::min(triangle[0].position.x,triangle[1].position.x), triangle[2].position.x),
-						std::min(std::min(triangle[0].position.y,triangle[1].position.y), triangle[2].position.y) };
+	RasterSetup setup{};
+	if (!SetupRasterTriangle(v0, v1, v2, setup))
+	{
+		return;
+	}
 
-	Vector2 bottomRight{	std::max(std::max(triangle[0].position.x,triangle[1].position.x), triangle[2].position.x),
-							std::max(std::max(triangle[0].position.y,triangle[1].position.y), triangle[2].position.y) };
+	const float invW[3]{ 1 / triangle[0].position.w, 1 / triangle[1].position.w, 1 / triangle[2].position.w };
 
-	topLeft.x = Clamp(topLeft.x, 0.f, float(m_Width - 1));
-	topLeft.y = Clamp(topLeft.y, 0.f, float(m_Height - 1));
-	bottomRight.x = Clamp(bottomRight.x, 0.f, float(m_Width - 1));
-	bottomRight.y = Clamp(bottomRight.y, 0.f, float(m_Height - 1));
+	Vector2 topLeft{};
+	Vector2 bottomRight{};
+	FindBoundingBoxCorners(topLeft, bottomRight, v0.GetXY(), v1.GetXY(), v2.GetXY());
 
-	for (int py{ int(topLeft.y) }; py < int(bottomRight.y); ++py)
-	{
-		for (int px{ int(topLeft.x) }; px < int(bottomRight.x); ++px)
+	RasterizeTriangle(setup, int(topLeft.x), int(topLeft.y), int(bottomRight.x), int(bottomRight.y), DepthTest::Less, [&](int px, int py, const Vector3& weights, float)
 		{
-			Vector3 weights{};
 			ColorRGB finalColor{};
-			const Vector2 pixel_ssc{ float(px) + 0.5f , float(py) + 0.5f };
-
-			const float area{ Vector2::Cross(Vector2(v1, v2), Vector2(v1, v0)) };
-
-			weights.x = CalculateWeights(v1, v2, pixel_ssc, area);
-			weights.y = CalculateWeights(v2, v0, pixel_ssc, area);
-			weights.z = CalculateWeights(v0, v1, pixel_ssc, area);
 
-			if (IsPointInTriangle(weights))
-			{
-				float zBufferValue{ 1 / ( (weights.x / triangle[0].position.z) + (weights.y / triangle[1].position.z) + (weights.z / triangle[2].position.z)) };
-
-				if (zBufferValue < m_pDepthBufferPixels[px + py * m_Width])
-				{
-					m_pDepthBufferPixels[px + (py * m_Width)] = zBufferValue;
-
-					const float wInterpolated{ 1 / ( (weights.x / triangle[0].position.w) + (weights.y / triangle[1].position.w) + (weights.z / triangle[2].position.w)) };
+			const float wInterpolated{ 1 / ( (weights.x * invW[0]) + (weights.y * invW[1]) + (weights.z * invW[2])) };
 
-					Vector2 uvInterpolated{ wInterpolated * (weights.x * (triangle[0].uv / triangle[0].position.w) +
-																weights.y * (triangle[1].uv / triangle[1].position.w) +
-																weights.z * (triangle[2].uv / triangle[2].position.w) )};
+			Vector2 uvInterpolated{ wInterpolated * (weights.x * (triangle[0].uv * invW[0]) +
+														weights.y * (triangle[1].uv * invW[1]) +
+														weights.z * (triangle[2].uv * invW[2]) )};
 
-					finalColor = m_pTextureTukTuk->Sample(uvInterpolated);
-					finalColor.MaxToOne();
-
-						
-
-					m_pBackBufferPixels[px + (py * m_Width)] = SDL_MapRGB(m_pBackBuffer->format,
-						static_cast<uint8_t>(finalColor.r * 255),
-						static_cast<uint8_t>(finalColor.g * 255),
-						static_cast<uint8_t>(finalColor.b * 255));
-				}
-			}
-		}
-	}
+			finalColor = m_pTextureTukTuk->Sample(uvInterpolated);
+			m_pBackBufferPixels[px + (py * m_Width)] = PackColor(finalColor);
+		});
 }
 
 void Renderer::VertexTransformationFunction(std::vector<Vertex>& vertices_in, std::vector<Vertex>& vertices_out)
@@ -725,13 +2821,155 @@ void Renderer::VertexTransformationFunction(std::vector<Vertex>& vertices_in, st
 	}
 }
 
-bool Renderer::SaveBufferToImage() const
+void Renderer::CycleDepthFormat()
 {
-	return SDL_SaveBMP(m_pBackBuffer, "Rasterizer_ColorBuffer.bmp");
+	switch (m_DepthFormat)
+	{
+	case DepthFormat::Float32:
+		m_DepthFormat = DepthFormat::ReversedFloat32;
+		std::cout << "Depth Format: REVERSED-Z FLOAT32\n";
+		break;
+	case DepthFormat::ReversedFloat32:
+		m_DepthFormat = DepthFormat::Unorm24;
+		std::cout << "Depth Format: UNORM24\n";
+		break;
+	case DepthFormat::Unorm24:
+		m_DepthFormat = DepthFormat::Unorm16;
+		std::cout << "Depth Format: UNORM16\n";
+		break;
+	default:
+		m_DepthFormat = DepthFormat::Float32;
+		std::cout << "Depth Format: FLOAT32\n";
+		break;
+	}
+
+	// Reversed-Z needs its own projection, near maps to 1 and far to 0
+	m_Camera.isReversedZ = m_DepthFormat == DepthFormat::ReversedFloat32;
+	m_Camera.CalculateProjectionMatrix();
+}
+
+void Renderer::CycleCullMode()
+{
+	switch (m_pVehicleMesh->cullMode)
+	{
+	case CullMode::Back:
+		m_pVehicleMesh->cullMode = CullMode::Front;
+		std::cout << "Cull Mode: FRONT\n";
+		break;
+	case CullMode::Front:
+		m_pVehicleMesh->cullMode = CullMode::None;
+		std::cout << "Cull Mode: NONE\n";
+		break;
+	default:
+		m_pVehicleMesh->cullMode = CullMode::Back;
+		std::cout << "Cull Mode: BACK\n";
+		break;
+	}
+
+	for (Mesh* pLOD : m_VehicleLODs)
+	{
+		pLOD->cullMode = m_pVehicleMesh->cullMode;
+	}
+}
+
+void Renderer::ToggleDepthPrePass()
+{
+	m_IsDepthPrePassEnabled = !m_IsDepthPrePassEnabled;
+	std::cout << "Depth Pre-Pass: " << (m_IsDepthPrePassEnabled ? "ON" : "OFF") << "\n";
+}
+
+void Renderer::ToggleDepthSorting()
+{
+	m_IsDepthSortEnabled = !m_IsDepthSortEnabled;
+	std::cout << "Depth Sorting: " << (m_IsDepthSortEnabled ? "ON" : "OFF") << "\n";
+}
+
+void Renderer::PrintStatistics()
+{
+	if (m_NrStatisticsFrames == 0)
+	{
+		return;
+	}
+
+	// Overdraw counts fragments that passed the depth test and were overwritten later, it is the work a front-to-back order saves
+	const double nrFrames{ double(m_NrStatisticsFrames) };
+	std::cout << "Depth Sorting: " << (m_IsDepthSortEnabled ? "ON" : "OFF")
+		<< " | Sort: " << (m_DepthSortTime * 1000.0 / nrFrames) << " ms"
+		<< " | Depth Passed: " << uint64_t(double(m_NrDepthPassedFragments) / nrFrames)
+		<< " | Overdraw: " << uint64_t(double(m_NrDepthPassedFragments - m_NrResolvedPixels) / nrFrames)
+		<< " | Attribute Setups: " << uint64_t(double(m_NrAttributePlaneSetups) / nrFrames) << " / " << uint64_t(double(m_NrTriangleRecords) / nrFrames) << "\n";
+
+	// ACMR here is transforms per triangle read from the index buffer, once for full vertices and once for position-only transforms
+	// Position-only transforms come from the depth pre-pass and the up front positions of on-demand transformation
+	const double nrAssembledTriangles{ double(std::max(m_NrAssembledTriangles, uint64_t(1))) };
+	std::cout << "On-Demand Transform: " << (m_IsOnDemandTransformEnabled ? "ON" : "OFF")
+		<< " | Vertex Transforms: " << uint64_t(double(m_NrVertexTransforms) / nrFrames)
+		<< " | Position Transforms: " << uint64_t(double(m_NrPositionTransforms) / nrFrames)
+		<< " | ACMR: " << (double(m_NrVertexTransforms) / nrAssembledTriangles) << " full / " << (double(m_NrPositionTransforms) / nrAssembledTriangles) << " position"
+		<< " | Visible Clusters: " << uint64_t(double(m_NrVisibleClusters) / nrFrames) << " / " << uint64_t(double(m_NrClusters) / nrFrames)
+		<< " | Visible Instances: " << uint64_t(double(m_NrVisibleInstances) / nrFrames) << " / " << uint64_t(double(m_NrInstances) / nrFrames) << "\n";
+
+	std::cout << "LOD: " << (m_IsLODEnabled ? "ON" : "OFF") << " | Instances per LOD:";
+	for (size_t lodIdx = 0; lodIdx < m_VehicleLODs.size(); ++lodIdx)
+	{
+		std::cout << (lodIdx > 0 ? " / " : " ") << uint64_t(double(m_NrLODInstances[lodIdx]) / nrFrames);
+	}
+	std::cout << "\n";
+
+	m_DepthSortTime = 0.0;
+	m_NrDepthPassedFragments = 0;
+	m_NrResolvedPixels = 0;
+	m_NrVertexTransforms = 0;
+	m_NrPositionTransforms = 0;
+	m_NrAssembledTriangles = 0;
+	m_NrTriangleRecords = 0;
+	m_NrAttributePlaneSetups = 0;
+	m_NrVisibleClusters = 0;
+	m_NrClusters = 0;
+	m_NrVisibleInstances = 0;
+	m_NrInstances = 0;
+	m_NrLODInstances.fill(0);
+	m_NrStatisticsFrames = 0;
+}
+
+void Renderer::ToggleOnDemandTransform()
+{
+	m_IsOnDemandTransformEnabled = !m_IsOnDemandTransformEnabled;
+	std::cout << "On-Demand Transform: " << (m_IsOnDemandTransformEnabled ? "ON" : "OFF") << "\n";
 }
 
-float Renderer::CalculateWeights(const Vector2& vertex1, const Vector2& vertex2, const Vector2& pixel, float area) const
+void Renderer::ToggleInstancing()
 {
-	return Vector2::Cross(vertex2 - vertex1, pixel - vertex1) / area;
+	m_IsInstancingEnabled = !m_IsInstancingEnabled;
+	std::cout << "Instancing: " << (m_IsInstancingEnabled ? "ON" : "OFF") << "\n";
 }
 
+void Renderer::ToggleLOD()
+{
+	m_IsLODEnabled = !m_IsLODEnabled;
+	std::cout << "LOD: " << (m_IsLODEnabled ? "ON" : "OFF") << "\n";
+}
+
+void Renderer::CycleLODHysteresis()
+{
+	// None, the default and a wide margin
+	SetLODHysteresis(m_LODHysteresis < 0.125f ? 0.25f : m_LODHysteresis < 0.375f ? 0.5f : 0.f);
+}
+
+void Renderer::SetLODHysteresis(float hysteresis)
+{
+	// At 1 or more coarser LODs would need a zero or negative projected error and never get picked
+	m_LODHysteresis = std::clamp(hysteresis, 0.f, 0.95f);
+	std::cout << "LOD Hysteresis: " << int(m_LODHysteresis * 100.f + 0.5f) << "%\n";
+}
+
+void Renderer::ToggleVisibilityBuffer()
+{
+	m_IsVisibilityBufferEnabled = !m_IsVisibilityBufferEnabled;
+	std::cout << "Visibility Buffer: " << (m_IsVisibilityBufferEnabled ? "ON" : "OFF") << "\n";
+}
+
+bool Renderer::SaveBufferToImage() const
+{
+	return SDL_SaveBMP(m_pBackBuffer, "Rasterizer_ColorBuffer.bmp");
+}
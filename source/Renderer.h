@@ -1,5 +1,7 @@
 
+#include <array>
 #include <cstdint>
+#include <immintrin.h>
 #include <vector>
 
 #include "Camera.h"
@@ -15,6 +17,7 @@ namespace dae
 	class Timer;
 	class Scene;
 	class Texture;
+	class ThreadPool;
 
 	class Renderer final
 	{
@@ -40,6 +43,21 @@ namespace dae
 		void Update(Timer* pTimer);
 		void Render();
 
+		void ToggleVisibilityBuffer();
+		void ToggleDepthPrePass();
+		void CycleCullMode();
+		void CycleDepthFormat();
+		void ToggleDepthSorting();
+		void ToggleOnDemandTransform();
+		void ToggleInstancing();
+		void ToggleLOD();
+		void CycleLODHysteresis();
+		//Fraction of LOD_PIXEL_ERROR an instance has to clear before it switches LOD, clamped to [0, 0.95]
+		void SetLODHysteresis(float hysteresis);
+		void PrintStatistics();
+		//Depth-only draw of every instance into the tiles, Solution_W5 runs it for every mesh before the color pass
+		void RenderDepthOnly(Mesh* pMesh, const Matrix* pWorldMatrices, uint32_t nrInstances);
+
 		bool SaveBufferToImage() const;
 
 	private:
@@ -48,8 +66,70 @@ namespace dae
 		SDL_Surface* m_pFrontBuffer{ nullptr };
 		SDL_Surface* m_pBackBuffer{ nullptr };
 		uint32_t* m_pBackBufferPixels{};
+		uint32_t m_ClearColor{};
+
+		//Color output: shaded pixels are staged as float R, G and B planes, ResolveTile packs them per tile
+		//The shaded mask has one 64-bit word per row of a tile, so TILE_SIZE can be at most 64
+		float* m_pColorBuffer{};
+		uint64_t* m_pShadedPixelMask{};
+		uint32_t m_RedShift{};
+		uint32_t m_GreenShift{};
+		uint32_t m_BlueShift{};
+		uint32_t m_AlphaMask{};
+		__m128i m_RedShiftCount{};
+		__m128i m_GreenShiftCount{};
+		__m128i m_BlueShiftCount{};
+
+		//Depth keys, see EncodeDepth. Unorm16 and Unorm24 use the buffer as uint16_t and Depth24, they only touch its first half or three quarters
+		uint32_t* m_pDepthBufferPixels{};
+		DepthFormat m_DepthFormat{ DepthFormat::Float32 };
+		static constexpr uint32_t DEPTH_UNORM16_MAX{ 0xFFFF };
+		static constexpr uint32_t DEPTH_UNORM24_MAX{ 0xFFFFFF };
+		static constexpr uint32_t DEPTH_REVERSED_NEAR{ 0x3F800000 }; //Bit pattern of 1.f
+
+		static constexpr int DEPTH_BLOCK_SIZE{ 8 };
+		int m_NrDepthBlocksX{};
+		int m_NrDepthBlocksY{};
+		DepthBlock* m_pDepthBlocks{};
+
+		//Deferred shading: the rasterization pass only fills this, every covered pixel is shaded once afterwards
+		VisibilityEntry* m_pVisibilityBuffer{};
+		bool m_IsVisibilityBufferEnabled{};
+
+		//Depth pre-pass: depth is rendered first, the color pass then only shades fragments with an equal depth
+		bool m_IsDepthPrePassEnabled{};
+
+		//Front-to-back ordering: triangles are binned nearest first, so more fragments fail the depth test before shading
+		//The key is the upper half of the float bits of the nearest view depth, sorted with two 8-bit radix passes
+		bool m_IsDepthSortEnabled{};
+		std::vector<uint16_t> m_DepthSortKeys{};
+		std::vector<uint32_t> m_DepthSortOrder{};
+		std::vector<uint32_t> m_DepthSortScratch{};
 
-		float* m_pDepthBufferPixels{};
+		//On-demand transform: every position is transformed up front for culling, the full Vertex_Out only for triangles that
+		//survive it, through a FIFO post-transform cache in the order primitive assembly reaches the vertices
+		static constexpr uint32_t VERTEX_CACHE_SIZE{ 32 };
+		//Triangles per cluster, every cluster is tested against the frustum and its normal cone before any vertex work
+		static constexpr uint32_t CLUSTER_SIZE{ 64 };
+		bool m_IsOnDemandTransformEnabled{};
+		std::array<uint32_t, VERTEX_CACHE_SIZE> m_VertexCacheTags{};
+		std::array<Vertex_Out, VERTEX_CACHE_SIZE> m_VertexCache{};
+		uint32_t m_NextVertexCacheSlot{};
+
+		//Accumulated since the last PrintStatistics
+		double m_DepthSortTime{};
+		uint64_t m_NrDepthPassedFragments{};
+		uint64_t m_NrResolvedPixels{};
+		uint64_t m_NrVertexTransforms{};
+		uint64_t m_NrPositionTransforms{};
+		uint64_t m_NrAssembledTriangles{};
+		uint64_t m_NrTriangleRecords{};
+		uint64_t m_NrAttributePlaneSetups{};
+		uint64_t m_NrVisibleClusters{};
+		uint64_t m_NrClusters{};
+		uint64_t m_NrVisibleInstances{};
+		uint64_t m_NrInstances{};
+		uint32_t m_NrStatisticsFrames{};
 
 		Camera m_Camera{};
 
@@ -74,22 +154,147 @@ namespace dae
 
 		Mesh* m_pVehicleMesh{};
 
+		//Instancing: one mesh drawn with many world matrices, instances are culled as a whole and then transformed in batches
+		//A batch shares one pass over the vertices, the vertex reference masks have one bit per instance so 8 is the limit
+		static constexpr uint32_t INSTANCE_BATCH_SIZE{ 4 };
+		static constexpr int NR_INSTANCES_X{ 16 };
+		static constexpr int NR_INSTANCES_Z{ 8 };
+		static constexpr float INSTANCE_SCALE{ 0.25f };
+		static constexpr float INSTANCE_SPACING{ 12.f };
+		bool m_IsInstancingEnabled{};
+		std::vector<Matrix> m_VehicleInstances{};
+		std::vector<uint32_t> m_VisibleInstances{};
+
+		//LOD chain: LOD 0 is the loaded mesh, every next LOD aims for half its triangles and may deviate twice as far
+		//The chain stops early when a LOD can't remove a tenth of the triangles anymore
+		static constexpr uint32_t MAX_NR_LODS{ 5 };
+		static constexpr float LOD_BASE_ERROR{ 0.0025f }; //Relative to the bounding sphere radius
+		//A LOD is drawn when its error projects to at most LOD_PIXEL_ERROR pixels, a change needs m_LODHysteresis of margin
+		static constexpr float LOD_PIXEL_ERROR{ 1.f };
+		float m_LODHysteresis{ 0.25f };
+		bool m_IsLODEnabled{ true };
+		std::vector<Mesh*> m_VehicleLODs{};
+		uint32_t m_VehicleLOD{};
+		std::vector<uint32_t> m_VehicleInstanceLODs{};
+		std::vector<std::vector<Matrix>> m_LODInstances{};
+		std::array<uint64_t, MAX_NR_LODS> m_NrLODInstances{};
+
+		//Tile Binning
+		static constexpr int TILE_SIZE{ 64 };
+		static constexpr int SUBPIXEL_BITS{ 8 };
+		static constexpr int SUBPIXEL_SCALE{ 1 << SUBPIXEL_BITS };
+		//Triangles whose clamped bounding box fits in this many pixels per side skip the block traversal
+		static constexpr int SMALL_TRIANGLE_SIZE{ 4 };
+		int m_NrTilesX{};
+		int m_NrTilesY{};
+		//Pixel count of the tiled depth, visibility and color staging buffers
+		int m_NrTiledPixels{};
+		std::vector<Tile> m_Tiles{};
+		//Primitive assembly stream, cleared every frame but never shrunk, it stops allocating once it fits the largest frame
+		std::vector<TriangleRecord> m_Triangles{};
+		//Indexed like m_Triangles, only set up for triangles that can still produce a fragment
+		std::vector<AttributePlanes> m_AttributePlanes{};
+		std::vector<uint32_t> m_AttributeSetupCounts{};
+		static constexpr uint32_t ATTRIBUTE_SETUP_BATCH_SIZE{ 256 };
+		std::vector<std::array<Vector3, 3>> m_DepthTrianglesScreenSpace{};
+
+		//Clipping: planes 0-5 are the view frustum (left, right, bottom, top, near, far), 6-9 the guard band
+		//Vertices inside the guard band are rasterized directly, it keeps the fixed-point edge equations in range
+		static constexpr int NR_CLIP_PLANES{ 10 };
+		static constexpr uint16_t FRUSTUM_MASK{ 0x3F };
+		static constexpr uint16_t CLIP_MASK{ 0x3F0 };
+		static constexpr float GUARD_BAND{ 8.f };
+		std::vector<Vertex_Out> m_ClipVertices{};
+		std::vector<Vertex_Out> m_ClipScratchVertices{};
+		std::vector<Vector4> m_ClipPositions{};
+		std::vector<Vector4> m_ClipScratchPositions{};
+		ThreadPool* m_pThreadPool{};
+		bool m_IsAVX2Supported{};
+
 		//Function that transforms the vertices from the mesh from World space to Screen space
 		void VertexTransformationFunction(std::vector<Vertex>& vertices_in, std::vector<Vertex>& vertices_out); //W1 Version
-		void VertexTransformationMatrix(Mesh* Mesh);
-		bool IsPointInTriangle(const Vector3& weights) const;
+		void VertexTransformationMatrix(Mesh* Mesh, const Matrix* pWorldMatrices, uint32_t nrInstances);
+		void VertexTransformationDepthOnly(Mesh* Mesh, const Matrix* pWorldMatrices, uint32_t nrInstances);
+		void VertexTransformationMatrixAVX2(Mesh* pMesh, const Matrix* pWorldMatrices, const Matrix* pWorldViewProjectionMatrices, uint32_t nrInstances);
+		void VertexTransformationDepthOnlyAVX2(Mesh* pMesh, const Matrix* pWorldViewProjectionMatrices, uint32_t nrInstances);
 		void Solution_W1();
 		void Solution_W2_W3();
 		void Solution_W4();
 		void Solution_W5();
 
-		float CalculateWeights(const Vector2& vertex1, const Vector2& vertex2, const Vector2& pixel, float area) const;
 		void RenderTriangle_W3(const std::vector<Vertex>& triangleScreenSpace) const;
 		void RenderTriangle_W4(std::vector<Vertex_Out>& triangle) const;
-		void RenderTriangle_W5(std::vector<Vertex_Out>& triangle) const;
-		bool IsFrustumCullingRequired(std::vector<Vertex_Out>& triangle) const;
+		float ViewToNDCDepth(float viewDepth) const;
+		uint32_t RenderTriangle_W5(const TriangleRecord& triangle, uint32_t triangleIdx, const Tile& tile) const;
+		void RenderTriangleDepth(const std::array<Vector3, 3>& triangle, const Tile& tile) const;
+		void RenderDepthOnlyBatch(Mesh* pMesh, const Matrix* pWorldMatrices, uint32_t nrInstances);
+		uint32_t CullMeshBatch(Mesh* pMesh, const Matrix* pWorldMatrices, uint32_t nrInstances);
+		void SelectLODs(const std::vector<Mesh*>& lods, const Matrix* pWorldMatrices, uint32_t* pInstanceLODs, uint32_t nrInstances);
+		uint32_t SelectLOD(const std::vector<Mesh*>& lods, const Matrix& worldMatrix, uint32_t currentLOD) const;
+		void DrawMeshInstanced(Mesh* pMesh, const Matrix* pWorldMatrices, uint32_t nrInstances);
+		void AssembleMeshInstance(const Mesh* pMesh, const Matrix& worldMatrix, uint32_t batchInstanceIdx);
+		void AssembleTriangle_W5(const Vertex_Out& v0, const Vertex_Out& v1, const Vertex_Out& v2, CullMode cullMode);
+		//The positions are already in screen space and past face culling
+		void AddTriangleRecord(const std::array<Vector4, 3>& positions, const Vertex_Out& v0, const Vertex_Out& v1, const Vertex_Out& v2);
+		void AssembleTriangleDepth(std::array<Vector4, 3> triangle, CullMode cullMode);
+		void SortTrianglesFrontToBack();
+		bool IsMeshInFrustum(const Mesh* pMesh, const Matrix& worldMatrix) const;
+		uint32_t CullClusters(Mesh* pMesh, const Matrix& worldMatrix, uint32_t batchInstanceIdx);
+		bool IsClusterFacingAway(const MeshCluster& cluster, const Vector3& cameraPosition, CullMode cullMode) const;
+		void FetchTriangleVertices(const Mesh* pMesh, const Matrix& worldMatrix, const Vector4* pPositions, const std::array<uint32_t, 3>& indices, std::array<const Vertex_Out*, 3>& vertices);
+		void TransformVertex(const Mesh* pMesh, const Matrix& worldMatrix, uint32_t vertexIdx, const Vector4& position, Vertex_Out& vertex_out) const;
+		void ShadeVisibilityBuffer(const Tile& tile) const;
+		bool IsTriangleShaded(const TriangleRecord& triangle) const;
+		void SetupAttributePlanes(const TriangleRecord& triangle, AttributePlanes& attributePlanes) const;
+		void ShadePixel_W5(int px, int py, const AttributePlanes& attributePlanes, const Vector3& weights) const;
+		bool IsFrustumCullingRequired(const uint16_t clipCodes[3]) const;
+		bool IsFaceCullingRequired(const Vector2& v0, const Vector2& v1, const Vector2& v2, CullMode cullMode) const;
+		uint16_t GetClipCode(const Vector4& position) const;
+		float GetClipDistance(const Vector4& position, int plane) const;
+		void ProjectToScreen(Vector4& position) const;
+
+		Vector4 LerpClipVertex(const Vector4& from, const Vector4& to, float factor) const;
+		Vertex_Out LerpClipVertex(const Vertex_Out& from, const Vertex_Out& to, float factor) const;
+		const Vector4& GetClipPosition(const Vector4& position) const { return position; };
+		const Vector4& GetClipPosition(const Vertex_Out& vertex) const { return vertex.position; };
+
+		template<typename ClipVertex>
+		void ClipTriangle(const std::array<ClipVertex, 3>& triangle, uint16_t clipPlanes, std::vector<ClipVertex>& polygon, std::vector<ClipVertex>& scratch) const;
 		ColorRGB PixelShading(const Vertex_Out& v) const ;
-		void FindBoundingBoxCorners(Vector2& topLeft, Vector2& botRight, const std::vector<Vertex_Out>& triangle) const ;
+		void FindBoundingBoxCorners(Vector2& topLeft, Vector2& botRight, const Vector2& v0, const Vector2& v1, const Vector2& v2) const ;
+		bool SetupRasterTriangle(const Vector3& v0, const Vector3& v1, const Vector3& v2, RasterSetup& setup) const;
+		bool SetupTileTriangle(const Vector3& v0, const Vector3& v1, const Vector3& v2, const Tile& tile, DepthTest depthTest, RasterSetup& setup, Int2& min, Int2& max) const;
+		BlockCoverage ClassifyBlock(const RasterSetup& setup, int minX, int minY, int maxX, int maxY) const;
+		uint16_t GetSmallTriangleCoverage(const RasterSetup& setup, int minX, int minY, int maxX, int maxY) const;
+		bool IsOccluded(uint32_t nearestDepth, int minX, int minY, int maxX, int maxY, DepthTest depthTest) const;
+		bool IsBlockOccluding(const DepthBlock& block, uint32_t nearestDepth, DepthTest depthTest) const;
+		void UpdateDepthBlock(int blockX, int blockY) const;
+		//Tiles are stored one after the other, row-major inside a tile, so a tile is one contiguous block of TILE_SIZE * TILE_SIZE pixels
+		int GetPixelIndex(int px, int py) const { return ((px / TILE_SIZE) + ((py / TILE_SIZE) * m_NrTilesX)) * (TILE_SIZE * TILE_SIZE) + ((py % TILE_SIZE) * TILE_SIZE) + (px % TILE_SIZE); };
+		uint32_t GetStoredDepth(int pixelIdx) const;
+		uint32_t GetDepthClearValue() const;
+		uint32_t EncodeDepth(float depth) const;
+		__m256i EncodeDepthAVX2(__m256 depth) const;
+		template<typename DepthType>
+		__m256i LoadDepthSpan(const DepthType* pDepth, int laneMask, __m256i lanes) const;
+		template<typename DepthType>
+		void StoreDepthSpan(DepthType* pDepth, int laneMask, __m256i lanes, __m256i depthKey) const;
+		template<typename PixelShader>
+		void RasterizeTriangle(const RasterSetup& setup, int minX, int minY, int maxX, int maxY, DepthTest depthTest, const PixelShader& shadePixel) const;
+		template<typename DepthType, typename PixelShader>
+		void RasterizeSmallTriangle(const RasterSetup& setup, int minX, int minY, DepthTest depthTest, const PixelShader& shadePixel) const;
+		template<typename DepthType, typename PixelShader>
+		bool RasterizeRect(const RasterSetup& setup, int minX, int minY, int maxX, int maxY, DepthTest depthTest, bool isDepthTestRequired, bool isFullyCovered, const PixelShader& shadePixel) const;
+		template<typename DepthType, typename PixelShader>
+		bool RasterizeRectAVX2(const RasterSetup& setup, int minX, int minY, int maxX, int maxY, DepthTest depthTest, bool isDepthTestRequired, bool isFullyCovered, const PixelShader& shadePixel) const;
+		void BinTriangle(uint32_t triangleIdx, const Vector2& v0, const Vector2& v1, const Vector2& v2);
+		void ClearTile(Tile& tile) const;
+		void ClearAllTiles();
+		uint32_t ResolveTile(const Tile& tile) const;
+		void WritePixel(int px, int py, const ColorRGB& color) const;
+		uint32_t PackColor(ColorRGB color) const;
+		void ClearTileColor(const Tile& tile) const;
+		void RenderTile(Tile& tile) const;
 	};
 
 }
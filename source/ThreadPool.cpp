@@ -0,0 +1,91 @@
+#include "ThreadPool.h"
+
+using namespace dae;
+
+ThreadPool::ThreadPool(uint32_t nrThreads)
+{
+	//The calling thread takes part in every ParallelFor, so it counts as one of the threads
+	const uint32_t nrWorkers{ nrThreads > 1 ? nrThreads - 1 : 0 };
+
+	m_Workers.reserve(nrWorkers);
+	for (uint32_t idx = 0; idx < nrWorkers; ++idx)
+	{
+		m_Workers.emplace_back(&ThreadPool::WorkerLoop, this);
+	}
+}
+
+ThreadPool::~ThreadPool()
+{
+	{
+		std::lock_guard<std::mutex> lock{ m_Mutex };
+		m_IsShuttingDown = true;
+	}
+	m_WakeCondition.notify_all();
+
+	for (std::thread& worker : m_Workers)
+	{
+		worker.join();
+	}
+}
+
+void ThreadPool::ParallelFor(uint32_t nrJobs, const std::function<void(uint32_t)>& job)
+{
+	if (nrJobs == 0)
+	{
+		return;
+	}
+
+	{
+		std::lock_guard<std::mutex> lock{ m_Mutex };
+		m_pJob = &job;
+		m_NrJobs = nrJobs;
+		m_NextJob = 0;
+		m_NrWorkersBusy = uint32_t(m_Workers.size());
+		++m_Generation;
+	}
+	m_WakeCondition.notify_all();
+
+	RunJobs();
+
+	//Wait for the workers, they might still be running the last jobs
+	std::unique_lock<std::mutex> lock{ m_Mutex };
+	m_DoneCondition.wait(lock, [this]() { return m_NrWorkersBusy == 0; });
+	m_pJob = nullptr;
+}
+
+void ThreadPool::WorkerLoop()
+{
+	uint64_t lastGeneration{};
+
+	while (true)
+	{
+		{
+			std::unique_lock<std::mutex> lock{ m_Mutex };
+			m_WakeCondition.wait(lock, [&]() { return m_IsShuttingDown || m_Generation != lastGeneration; });
+
+			if (m_IsShuttingDown)
+			{
+				return;
+			}
+
+			lastGeneration = m_Generation;
+		}
+
+		RunJobs();
+
+		std::lock_guard<std::mutex> lock{ m_Mutex };
+		if (--m_NrWorkersBusy == 0)
+		{
+			m_DoneCondition.notify_one();
+		}
+	}
+}
+
+void ThreadPool::RunJobs()
+{
+	//Jobs are handed out one at a time, so a thread that finishes early simply takes the next one
+	for (uint32_t idx{ m_NextJob++ }; idx < m_NrJobs; idx = m_NextJob++)
+	{
+		(*m_pJob)(idx);
+	}
+}
@@ -0,0 +1,49 @@
+#pragma once
+
+//Standard includes
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace dae
+{
+	class ThreadPool final
+	{
+	public:
+		ThreadPool(uint32_t nrThreads = std::thread::hardware_concurrency());
+		~ThreadPool();
+
+		ThreadPool(const ThreadPool&) = delete;
+		ThreadPool(ThreadPool&&) noexcept = delete;
+		ThreadPool& operator=(const ThreadPool&) = delete;
+		ThreadPool& operator=(ThreadPool&&) noexcept = delete;
+
+		//Runs job(idx) for every idx in [0, nrJobs) on the workers and the calling thread
+		//Returns once every job has finished
+		void ParallelFor(uint32_t nrJobs, const std::function<void(uint32_t)>& job);
+
+		uint32_t GetNrThreads() const { return uint32_t(m_Workers.size()) + 1; };
+
+	private:
+		void WorkerLoop();
+		void RunJobs();
+
+		std::vector<std::thread> m_Workers{};
+
+		std::mutex m_Mutex{};
+		std::condition_variable m_WakeCondition{};
+		std::condition_variable m_DoneCondition{};
+
+		const std::function<void(uint32_t)>* m_pJob{ nullptr };
+		uint32_t m_NrJobs{};
+		std::atomic<uint32_t> m_NextJob{};
+
+		uint64_t m_Generation{};
+		uint32_t m_NrWorkersBusy{};
+		bool m_IsShuttingDown{};
+	};
+}
@@ -1,9 +1,17 @@
 #pragma once
+#include <algorithm>
 #include <cassert>
 #include <fstream>
+#include <unordered_map>
 #include "Math.h"
 #include "DataTypes.h"
 
+#ifdef _MSC_VER
+#include <intrin.h>
+#else
+#include <cpuid.h>
+#endif
+
 //#define DISABLE_OBJ
 
 namespace dae
@@ -31,6 +39,20 @@ namespace dae
 			std::vector<Vector3> normals{};
 			std::vector<Vector2> UVs{};
 
+			//Welding: every distinct position/uv/normal index triple becomes one vertex, 0 marks a missing uv or normal
+			struct CornerKey
+			{
+				size_t iPosition{};
+				size_t iTexCoord{};
+				size_t iNormal{};
+				bool operator==(const CornerKey& other) const = default;
+			};
+			const auto hashCornerKey{ [](const CornerKey& key)
+				{
+					return std::hash<size_t>{}((key.iPosition * 73856093) ^ (key.iTexCoord * 19349663) ^ (key.iNormal * 83492791));
+				} };
+			std::unordered_map<CornerKey, uint32_t, decltype(hashCornerKey)> vertexIndices{ 0, hashCornerKey };
+
 			vertices.clear();
 			indices.clear();
 
@@ -76,15 +98,15 @@ namespace dae
 					//add the material index as attibute to the attribute array
 					//
 					// Faces or triangles
-					Vertex vertex{ Vertex() };
-					size_t iPosition, iTexCoord, iNormal;
-
 					uint32_t tempIndices[3];
 					for (size_t iFace = 0; iFace < 3; iFace++)
 					{
+						Vertex vertex{ Vertex() };
+						CornerKey key{};
+
 						// OBJ format uses 1-based arrays
-						file >> iPosition;
-						vertex.position = positions[iPosition - 1];
+						file >> key.iPosition;
+						vertex.position = positions[key.iPosition - 1];
 
 						if ('/' == file.peek())//is next in buffer ==  '/' ?
 						{
@@ -93,8 +115,8 @@ namespace dae
 							if ('/' != file.peek())
 							{
 								// Optional texture coordinate
-								file >> iTexCoord;
-								vertex.uv = UVs[iTexCoord - 1];
+								file >> key.iTexCoord;
+								vertex.uv = UVs[key.iTexCoord - 1];
 							}
 
 							if ('/' == file.peek())
@@ -102,14 +124,18 @@ namespace dae
 								file.ignore();
 
 								// Optional vertex normal
-								file >> iNormal;
-								vertex.normal = normals[iNormal - 1];
+								file >> key.iNormal;
+								vertex.normal = normals[key.iNormal - 1];
 							}
 						}
 
-						vertices.push_back(vertex);
-						tempIndices[iFace] = uint32_t(vertices.size()) - 1;
-						//indices.push_back(uint32_t(vertices.size()) - 1);
+						// Corners that were seen before reuse their vertex
+						const auto [it, isNewVertex] { vertexIndices.try_emplace(key, uint32_t(vertices.size())) };
+						if (isNewVertex)
+						{
+							vertices.push_back(vertex);
+						}
+						tempIndices[iFace] = it->second;
 					}
 
 					indices.push_back(tempIndices[0]);
@@ -146,7 +172,12 @@ namespace dae
 				const Vector3 edge1 = p2 - p0;
 				const Vector2 diffX = Vector2(uv1.x - uv0.x, uv2.x - uv0.x);
 				const Vector2 diffY = Vector2(uv1.y - uv0.y, uv2.y - uv0.y);
-				float r = 1.f / Vector2::Cross(diffX, diffY);
+
+				//Vertices are shared between triangles, a triangle without uv area would spread an infinite tangent
+				const float uvArea = Vector2::Cross(diffX, diffY);
+				if (std::abs(uvArea) <= FLT_MIN)
+					continue;
+				float r = 1.f / uvArea;
 
 				Vector3 tangent = (edge0 * diffY.y - edge1 * diffY.x) * r;
 				vertices[index0].tangent += tangent;
@@ -171,6 +202,946 @@ namespace dae
 			return true;
 #endif
 		}
+
+		static size_t GetNrTriangles(const Mesh& mesh)
+		{
+			if (mesh.primitiveTopology == PrimitiveTopology::TriangleList)
+			{
+				return mesh.indices.size() / 3;
+			}
+
+			// Every index after the first two starts a new triangle
+			return mesh.indices.size() >= 3 ? mesh.indices.size() - 2 : 0;
+		}
+
+		static bool GetTriangleIndices(const Mesh& mesh, size_t triangleIdx, std::array<uint32_t, 3>& indices)
+		{
+			if (mesh.primitiveTopology == PrimitiveTopology::TriangleList)
+			{
+				const uint32_t* pIndices{ &mesh.indices[triangleIdx * 3] };
+				indices = { pIndices[0], pIndices[1], pIndices[2] };
+				return true;
+			}
+
+			// Odd triangles of a strip swap their last two indices to keep the winding of the strip
+			const uint32_t* pIndices{ &mesh.indices[triangleIdx] };
+			if (triangleIdx % 2 == 0)
+			{
+				indices = { pIndices[0], pIndices[1], pIndices[2] };
+			}
+			else
+			{
+				indices = { pIndices[0], pIndices[2], pIndices[1] };
+			}
+
+			// A repeated index makes a degenerate triangle, those only join two strips
+			return indices[0] != indices[1] && indices[1] != indices[2] && indices[0] != indices[2];
+		}
+
+		//Object space AABB and bounding sphere of the vertices, the sphere is centered on the AABB
+		static void CalculateMeshBounds(Mesh& mesh)
+		{
+			if (mesh.vertices.empty())
+			{
+				mesh.boundsMin = mesh.boundsMax = mesh.boundingSphereCenter = {};
+				mesh.boundingSphereRadius = 0.f;
+				return;
+			}
+
+			Vector3 boundsMin{ mesh.vertices[0].position };
+			Vector3 boundsMax{ boundsMin };
+			for (const Vertex& vertex : mesh.vertices)
+			{
+				boundsMin = { std::min(boundsMin.x, vertex.position.x), std::min(boundsMin.y, vertex.position.y), std::min(boundsMin.z, vertex.position.z) };
+				boundsMax = { std::max(boundsMax.x, vertex.position.x), std::max(boundsMax.y, vertex.position.y), std::max(boundsMax.z, vertex.position.z) };
+			}
+
+			// The farthest vertex from the center gives a tighter radius than half the diagonal
+			const Vector3 center{ (boundsMin + boundsMax) * 0.5f };
+			float radiusSquared{};
+			for (const Vertex& vertex : mesh.vertices)
+			{
+				radiusSquared = std::max(radiusSquared, (vertex.position - center).SqrMagnitude());
+			}
+
+			mesh.boundsMin = boundsMin;
+			mesh.boundsMax = boundsMax;
+			mesh.boundingSphereCenter = center;
+			mesh.boundingSphereRadius = sqrtf(radiusSquared);
+		}
+
+		//Copies the attributes the transform stage reads into separate streams, run this once the vertex buffer is final
+		static void BuildVertexStreams(Mesh& mesh)
+		{
+			const size_t nrVertices{ mesh.vertices.size() };
+			const size_t nrPaddedVertices{ ((nrVertices + VERTEX_STREAM_WIDTH - 1) / VERTEX_STREAM_WIDTH) * VERTEX_STREAM_WIDTH };
+
+			VertexStreams& streams{ mesh.vertexStreams };
+			for (std::vector<float>* pStream : { &streams.positionX, &streams.positionY, &streams.positionZ, &streams.u, &streams.v,
+				&streams.normalX, &streams.normalY, &streams.normalZ, &streams.tangentX, &streams.tangentY, &streams.tangentZ })
+			{
+				pStream->assign(nrPaddedVertices, 0.f);
+			}
+
+			for (size_t idx = 0; idx < nrVertices; ++idx)
+			{
+				const Vertex& vertex{ mesh.vertices[idx] };
+				streams.positionX[idx] = vertex.position.x;
+				streams.positionY[idx] = vertex.position.y;
+				streams.positionZ[idx] = vertex.position.z;
+				streams.u[idx] = vertex.uv.x;
+				streams.v[idx] = vertex.uv.y;
+				streams.normalX[idx] = vertex.normal.x;
+				streams.normalY[idx] = vertex.normal.y;
+				streams.normalZ[idx] = vertex.normal.z;
+				streams.tangentX[idx] = vertex.tangent.x;
+				streams.tangentY[idx] = vertex.tangent.y;
+				streams.tangentZ[idx] = vertex.tangent.z;
+			}
+		}
+
+		//Splits the triangles into runs of clusterSize in primitive order, so run this after the index buffer is in its final order
+		//Vertex cache optimization keeps consecutive triangles close together, which keeps the bounds and normal cones tight
+		static void BuildMeshClusters(Mesh& mesh, uint32_t clusterSize)
+		{
+			const uint32_t nrTriangles{ uint32_t(GetNrTriangles(mesh)) };
+			mesh.clusters.clear();
+
+			for (uint32_t firstTriangle = 0; firstTriangle < nrTriangles; firstTriangle += clusterSize)
+			{
+				MeshCluster& cluster{ mesh.clusters.emplace_back() };
+				cluster.firstTriangle = firstTriangle;
+				cluster.nrTriangles = std::min(clusterSize, nrTriangles - firstTriangle);
+
+				Vector3 minPosition{ FLT_MAX, FLT_MAX, FLT_MAX };
+				Vector3 maxPosition{ -FLT_MAX, -FLT_MAX, -FLT_MAX };
+				Vector3 normalSum{};
+				for (uint32_t triangleIdx = firstTriangle; triangleIdx < firstTriangle + cluster.nrTriangles; ++triangleIdx)
+				{
+					std::array<uint32_t, 3> indices{};
+					if (!GetTriangleIndices(mesh, triangleIdx, indices))
+					{
+						continue;
+					}
+
+					for (uint32_t index : indices)
+					{
+						const Vector3& position{ mesh.vertices[index].position };
+						minPosition = { std::min(minPosition.x, position.x), std::min(minPosition.y, position.y), std::min(minPosition.z, position.z) };
+						maxPosition = { std::max(maxPosition.x, position.x), std::max(maxPosition.y, position.y), std::max(maxPosition.z, position.z) };
+					}
+
+					Vector3 normal{ Vector3::Cross(mesh.vertices[indices[1]].position - mesh.vertices[indices[0]].position, mesh.vertices[indices[2]].position - mesh.vertices[indices[0]].position) };
+					if (normal.Normalize() > 0.f)
+					{
+						normalSum += normal;
+					}
+				}
+
+				//Only degenerate triangles, the cluster keeps an empty sphere and never gets culled by its cone
+				if (minPosition.x > maxPosition.x)
+				{
+					continue;
+				}
+
+				cluster.center = (minPosition + maxPosition) / 2.f;
+				for (uint32_t triangleIdx = firstTriangle; triangleIdx < firstTriangle + cluster.nrTriangles; ++triangleIdx)
+				{
+					std::array<uint32_t, 3> indices{};
+					if (!GetTriangleIndices(mesh, triangleIdx, indices))
+					{
+						continue;
+					}
+
+					for (uint32_t index : indices)
+					{
+						cluster.radius = std::max(cluster.radius, (mesh.vertices[index].position - cluster.center).Magnitude());
+					}
+				}
+
+				if (normalSum.Normalize() <= 0.f)
+				{
+					continue;
+				}
+
+				//The widest normal decides the half angle, a cone of 90 degrees or more can't reject anything
+				float minDot{ 1.f };
+				for (uint32_t triangleIdx = firstTriangle; triangleIdx < firstTriangle + cluster.nrTriangles; ++triangleIdx)
+				{
+					std::array<uint32_t, 3> indices{};
+					if (!GetTriangleIndices(mesh, triangleIdx, indices))
+					{
+						continue;
+					}
+
+					Vector3 normal{ Vector3::Cross(mesh.vertices[indices[1]].position - mesh.vertices[indices[0]].position, mesh.vertices[indices[2]].position - mesh.vertices[indices[0]].position) };
+					if (normal.Normalize() > 0.f)
+					{
+						minDot = std::min(minDot, Vector3::Dot(normal, normalSum));
+					}
+				}
+
+				cluster.coneAxis = normalSum;
+				cluster.coneCutoff = minDot > 0.f ? std::sqrt(1.f - (minDot * minDot)) : 1.f;
+			}
+		}
+
+		//Quadric error edge collapse (Garland and Heckbert 1997) of a triangle list until at most targetNrTriangles are left
+		//Collapses work on positions, a position holds one vertex per UV or normal chart that meets there
+		//Every collapse moves all vertices of a position onto the vertices of a neighbouring position, so the vertex buffer is shared
+		//and no attribute gets interpolated. UV seams and open borders are feature edges: a position on exactly two of them only
+		//moves along them, so seams keep their shape, and positions where more feature edges meet never move
+		//The error of a collapse is the area weighted RMS distance to the original planes in object space, collapses above maxError
+		//are skipped. Returns the largest error of the collapses that were made
+		static float SimplifyMesh(const std::vector<Vertex>& vertices, std::vector<uint32_t>& indices, size_t targetNrTriangles, float maxError)
+		{
+			//Sum of squared distances to a set of planes, weighted by triangle area: error(p) = p^T Q p
+			struct Quadric
+			{
+				//Upper triangle of the symmetric 4x4 matrix: aa, ab, ac, ad, bb, bc, bd, cc, cd, dd
+				std::array<double, 10> q{};
+				double weight{};
+
+				void AddPlane(const Vector3& normal, double d, double planeWeight)
+				{
+					const double a{ normal.x }, b{ normal.y }, c{ normal.z };
+					const std::array<double, 10> plane{ a * a, a * b, a * c, a * d, b * b, b * c, b * d, c * c, c * d, d * d };
+					for (size_t idx = 0; idx < q.size(); ++idx)
+					{
+						q[idx] += plane[idx] * planeWeight;
+					}
+					weight += planeWeight;
+				}
+
+				void Add(const Quadric& other)
+				{
+					for (size_t idx = 0; idx < q.size(); ++idx)
+					{
+						q[idx] += other.q[idx];
+					}
+					weight += other.weight;
+				}
+
+				double GetError(const Vector3& p) const
+				{
+					const double x{ p.x }, y{ p.y }, z{ p.z };
+					const double error{ (q[0] * x * x) + (2.0 * q[1] * x * y) + (2.0 * q[2] * x * z) + (2.0 * q[3] * x)
+						+ (q[4] * y * y) + (2.0 * q[5] * y * z) + (2.0 * q[6] * y)
+						+ (q[7] * z * z) + (2.0 * q[8] * z) + q[9] };
+					return std::max(error, 0.0);
+				}
+			};
+
+			struct Collapse
+			{
+				double cost{};
+				uint32_t from{};
+				uint32_t to{};
+				bool operator<(const Collapse& other) const { return cost > other.cost; };
+			};
+
+			enum class PositionKind
+			{
+				Interior,
+				Feature,
+				Locked
+			};
+
+			//Feature edge planes count this much more than the surface, relative to the squared edge length
+			constexpr double FEATURE_EDGE_WEIGHT{ 10.0 };
+
+			const uint32_t nrVertices{ uint32_t(vertices.size()) };
+			const uint32_t nrTriangles{ uint32_t(indices.size() / 3) };
+
+			//Vertices with the exact same position share a position index
+			std::vector<uint32_t> sortedVertices(nrVertices);
+			for (uint32_t vertexIdx = 0; vertexIdx < nrVertices; ++vertexIdx)
+			{
+				sortedVertices[vertexIdx] = vertexIdx;
+			}
+			const auto getPositionKey{ [&](uint32_t vertexIdx)
+				{
+					const Vector3& position{ vertices[vertexIdx].position };
+					return std::make_tuple(position.x, position.y, position.z);
+				} };
+			std::sort(sortedVertices.begin(), sortedVertices.end(), [&](uint32_t a, uint32_t b) { return getPositionKey(a) < getPositionKey(b); });
+
+			std::vector<uint32_t> vertexPositions(nrVertices);
+			std::vector<std::vector<uint32_t>> positionVertices{};
+			for (size_t sortedIdx = 0; sortedIdx < sortedVertices.size(); ++sortedIdx)
+			{
+				if (sortedIdx == 0 || getPositionKey(sortedVertices[sortedIdx]) != getPositionKey(sortedVertices[sortedIdx - 1]))
+				{
+					positionVertices.emplace_back();
+				}
+				vertexPositions[sortedVertices[sortedIdx]] = uint32_t(positionVertices.size() - 1);
+				positionVertices.back().push_back(sortedVertices[sortedIdx]);
+			}
+			const uint32_t nrPositions{ uint32_t(positionVertices.size()) };
+			const auto getPosition{ [&](uint32_t positionIdx) -> const Vector3& { return vertices[positionVertices[positionIdx][0]].position; } };
+
+			//Triangle fans per vertex and plane quadrics per position
+			std::vector<std::vector<uint32_t>> vertexTriangles(nrVertices);
+			std::vector<Quadric> quadrics(nrPositions);
+			for (uint32_t triangleIdx = 0; triangleIdx < nrTriangles; ++triangleIdx)
+			{
+				const uint32_t* pTriangle{ &indices[triangleIdx * 3] };
+				const Vector3& p0{ vertices[pTriangle[0]].position };
+				Vector3 normal{ Vector3::Cross(vertices[pTriangle[1]].position - p0, vertices[pTriangle[2]].position - p0) };
+				const float doubleArea{ normal.Normalize() };
+				for (int cornerIdx = 0; cornerIdx < 3; ++cornerIdx)
+				{
+					vertexTriangles[pTriangle[cornerIdx]].push_back(triangleIdx);
+					if (doubleArea > 0.f)
+					{
+						quadrics[vertexPositions[pTriangle[cornerIdx]]].AddPlane(normal, -Vector3::Dot(normal, p0), doubleArea * 0.5);
+					}
+				}
+			}
+
+			//An edge between two positions is a UV seam when its two triangles see different UVs at either end
+			//and a border when it has only one triangle, non-manifold edges lock both of their positions
+			std::unordered_map<uint64_t, std::vector<uint32_t>> edgeTriangles{};
+			const auto getEdgeKey{ [](uint32_t p0, uint32_t p1) { return (uint64_t(std::min(p0, p1)) << 32) | std::max(p0, p1); } };
+			for (uint32_t triangleIdx = 0; triangleIdx < nrTriangles; ++triangleIdx)
+			{
+				for (int cornerIdx = 0; cornerIdx < 3; ++cornerIdx)
+				{
+					const uint32_t p0{ vertexPositions[indices[triangleIdx * 3 + cornerIdx]] };
+					const uint32_t p1{ vertexPositions[indices[triangleIdx * 3 + (cornerIdx + 1) % 3]] };
+					edgeTriangles[getEdgeKey(p0, p1)].push_back(triangleIdx);
+				}
+			}
+
+			//Vertex of a position in one triangle
+			const auto getCorner{ [&](uint32_t triangleIdx, uint32_t positionIdx)
+				{
+					for (int cornerIdx = 0; cornerIdx < 3; ++cornerIdx)
+					{
+						if (vertexPositions[indices[triangleIdx * 3 + cornerIdx]] == positionIdx)
+						{
+							return indices[triangleIdx * 3 + cornerIdx];
+						}
+					}
+					return UINT32_MAX;
+				} };
+			const auto isSameUV{ [&](uint32_t v0, uint32_t v1) { return vertices[v0].uv.x == vertices[v1].uv.x && vertices[v0].uv.y == vertices[v1].uv.y; } };
+			const auto isFeatureEdge{ [&](uint32_t p0, uint32_t p1, const std::vector<uint32_t>& triangles)
+				{
+					return triangles.size() == 1
+						|| !isSameUV(getCorner(triangles[0], p0), getCorner(triangles[1], p0)) || !isSameUV(getCorner(triangles[0], p1), getCorner(triangles[1], p1));
+				} };
+
+			std::vector<uint32_t> nrFeatureEdges(nrPositions);
+			std::vector<bool> isLocked(nrPositions);
+			for (const auto& [edge, triangles] : edgeTriangles)
+			{
+				const uint32_t p0{ uint32_t(edge >> 32) };
+				const uint32_t p1{ uint32_t(edge & UINT32_MAX) };
+				if (triangles.size() > 2)
+				{
+					isLocked[p0] = true;
+					isLocked[p1] = true;
+				}
+				else if (isFeatureEdge(p0, p1, triangles))
+				{
+					++nrFeatureEdges[p0];
+					++nrFeatureEdges[p1];
+
+					//Planes through the edge, perpendicular to its triangles, so sliding along a feature edge costs what it bends it
+					const Vector3& e0{ getPosition(p0) };
+					const Vector3 edge{ getPosition(p1) - e0 };
+					for (uint32_t triangleIdx : triangles)
+					{
+						const uint32_t* pTriangle{ &indices[triangleIdx * 3] };
+						const Vector3 triangleNormal{ Vector3::Cross(vertices[pTriangle[1]].position - vertices[pTriangle[0]].position, vertices[pTriangle[2]].position - vertices[pTriangle[0]].position) };
+						Vector3 normal{ Vector3::Cross(edge, triangleNormal) };
+						if (normal.Normalize() > 0.f)
+						{
+							const double planeWeight{ edge.SqrMagnitude() * FEATURE_EDGE_WEIGHT };
+							quadrics[p0].AddPlane(normal, -Vector3::Dot(normal, e0), planeWeight);
+							quadrics[p1].AddPlane(normal, -Vector3::Dot(normal, e0), planeWeight);
+						}
+					}
+				}
+			}
+
+			//A position moves freely without feature edges, along them when exactly two pass through it and not at all otherwise
+			std::vector<PositionKind> positionKinds(nrPositions);
+			for (uint32_t positionIdx = 0; positionIdx < nrPositions; ++positionIdx)
+			{
+				if (isLocked[positionIdx])
+				{
+					positionKinds[positionIdx] = PositionKind::Locked;
+				}
+				else if (nrFeatureEdges[positionIdx] == 0)
+				{
+					positionKinds[positionIdx] = PositionKind::Interior;
+				}
+				else if (nrFeatureEdges[positionIdx] == 2)
+				{
+					positionKinds[positionIdx] = PositionKind::Feature;
+				}
+				else
+				{
+					positionKinds[positionIdx] = PositionKind::Locked;
+				}
+			}
+
+			const auto gatherNeighbours{ [&](uint32_t positionIdx, std::vector<uint32_t>& neighbours)
+				{
+					neighbours.clear();
+					for (uint32_t vertexIdx : positionVertices[positionIdx])
+					{
+						for (uint32_t triangleIdx : vertexTriangles[vertexIdx])
+						{
+							for (int cornerIdx = 0; cornerIdx < 3; ++cornerIdx)
+							{
+								const uint32_t neighbour{ vertexPositions[indices[triangleIdx * 3 + cornerIdx]] };
+								if (neighbour != positionIdx && std::find(neighbours.begin(), neighbours.end(), neighbour) == neighbours.end())
+								{
+									neighbours.push_back(neighbour);
+								}
+							}
+						}
+					}
+				} };
+
+			//Min-heap of collapses, costs only grow as quadrics get merged, so a stale entry is re-evaluated when it comes up
+			std::vector<Collapse> collapses{};
+			const auto getCollapseCost{ [&](uint32_t from, uint32_t to)
+				{
+					return quadrics[from].GetError(getPosition(to)) + quadrics[to].GetError(getPosition(to));
+				} };
+			const auto pushCollapse{ [&](uint32_t from, uint32_t to)
+				{
+					if (positionKinds[from] != PositionKind::Locked)
+					{
+						collapses.push_back({ getCollapseCost(from, to), from, to });
+						std::push_heap(collapses.begin(), collapses.end());
+					}
+				} };
+
+			for (const auto& [edge, triangles] : edgeTriangles)
+			{
+				pushCollapse(uint32_t(edge >> 32), uint32_t(edge & UINT32_MAX));
+				pushCollapse(uint32_t(edge & UINT32_MAX), uint32_t(edge >> 32));
+			}
+
+			std::vector<bool> isTriangleRemoved(nrTriangles);
+			std::vector<uint32_t> fromNeighbours{};
+			std::vector<uint32_t> toNeighbours{};
+			std::vector<uint32_t> sharedTriangles{};
+			std::vector<std::pair<uint32_t, uint32_t>> vertexMoves{};
+			size_t nrLiveTriangles{ nrTriangles };
+			double largestError{};
+
+			while (nrLiveTriangles > targetNrTriangles && !collapses.empty())
+			{
+				std::pop_heap(collapses.begin(), collapses.end());
+				const Collapse collapse{ collapses.back() };
+				collapses.pop_back();
+
+				const uint32_t from{ collapse.from };
+				const uint32_t to{ collapse.to };
+				if (positionVertices[from].empty() || positionVertices[to].empty())
+				{
+					continue;
+				}
+
+				const double cost{ getCollapseCost(from, to) };
+				if (cost > collapse.cost)
+				{
+					collapses.push_back({ cost, from, to });
+					std::push_heap(collapses.begin(), collapses.end());
+					continue;
+				}
+
+				const double weight{ quadrics[from].weight + quadrics[to].weight };
+				const double error{ weight > 0.0 ? cost / weight : 0.0 };
+				if (error > double(maxError) * maxError)
+				{
+					continue;
+				}
+
+				//The edge has to exist, a position on feature edges only slides along one of them
+				sharedTriangles.clear();
+				for (uint32_t vertexIdx : positionVertices[from])
+				{
+					for (uint32_t triangleIdx : vertexTriangles[vertexIdx])
+					{
+						const uint32_t* pTriangle{ &indices[triangleIdx * 3] };
+						if (vertexPositions[pTriangle[0]] == to || vertexPositions[pTriangle[1]] == to || vertexPositions[pTriangle[2]] == to)
+						{
+							sharedTriangles.push_back(triangleIdx);
+						}
+					}
+				}
+				const bool isFeatureCollapse{ !sharedTriangles.empty() && sharedTriangles.size() <= 2 && isFeatureEdge(from, to, sharedTriangles) };
+				if (sharedTriangles.empty() || sharedTriangles.size() > 2 || isFeatureCollapse != (positionKinds[from] == PositionKind::Feature))
+				{
+					continue;
+				}
+
+				//Every vertex of the position needs exactly one vertex of the target in its chart to move onto
+				vertexMoves.clear();
+				bool isValid{ true };
+				for (uint32_t vertexIdx : positionVertices[from])
+				{
+					uint32_t target{ UINT32_MAX };
+					for (uint32_t triangleIdx : sharedTriangles)
+					{
+						const uint32_t* pTriangle{ &indices[triangleIdx * 3] };
+						if (pTriangle[0] != vertexIdx && pTriangle[1] != vertexIdx && pTriangle[2] != vertexIdx)
+						{
+							continue;
+						}
+
+						for (int cornerIdx = 0; cornerIdx < 3; ++cornerIdx)
+						{
+							if (vertexPositions[pTriangle[cornerIdx]] == to)
+							{
+								isValid = isValid && (target == UINT32_MAX || target == pTriangle[cornerIdx]);
+								target = pTriangle[cornerIdx];
+							}
+						}
+					}
+
+					isValid = isValid && target != UINT32_MAX;
+					vertexMoves.emplace_back(vertexIdx, target);
+				}
+				if (!isValid)
+				{
+					continue;
+				}
+
+				//The positions may only share the opposite positions of the edge, anything else folds the surface onto itself (the link condition)
+				gatherNeighbours(from, fromNeighbours);
+				gatherNeighbours(to, toNeighbours);
+				uint32_t nrSharedNeighbours{};
+				for (uint32_t neighbour : fromNeighbours)
+				{
+					nrSharedNeighbours += std::find(toNeighbours.begin(), toNeighbours.end(), neighbour) != toNeighbours.end();
+				}
+				if (nrSharedNeighbours != sharedTriangles.size())
+				{
+					continue;
+				}
+
+				//Triangles that stay must not flip or collapse to a sliver
+				bool isFlipping{};
+				for (uint32_t vertexIdx : positionVertices[from])
+				{
+					for (uint32_t triangleIdx : vertexTriangles[vertexIdx])
+					{
+						if (std::find(sharedTriangles.begin(), sharedTriangles.end(), triangleIdx) != sharedTriangles.end())
+						{
+							continue;
+						}
+
+						const uint32_t* pTriangle{ &indices[triangleIdx * 3] };
+						std::array<Vector3, 3> corners{ vertices[pTriangle[0]].position, vertices[pTriangle[1]].position, vertices[pTriangle[2]].position };
+						const Vector3 oldNormal{ Vector3::Cross(corners[1] - corners[0], corners[2] - corners[0]).Normalized() };
+						for (int cornerIdx = 0; cornerIdx < 3; ++cornerIdx)
+						{
+							corners[cornerIdx] = pTriangle[cornerIdx] == vertexIdx ? getPosition(to) : corners[cornerIdx];
+						}
+						Vector3 newNormal{ Vector3::Cross(corners[1] - corners[0], corners[2] - corners[0]) };
+						if (newNormal.Normalize() <= FLT_MIN || Vector3::Dot(oldNormal, newNormal) < 0.25f)
+						{
+							isFlipping = true;
+						}
+					}
+				}
+				if (isFlipping)
+				{
+					continue;
+				}
+
+				//The triangles on the edge disappear, the rest of every fan moves over to its target vertex
+				for (uint32_t triangleIdx : sharedTriangles)
+				{
+					isTriangleRemoved[triangleIdx] = true;
+					--nrLiveTriangles;
+					for (int cornerIdx = 0; cornerIdx < 3; ++cornerIdx)
+					{
+						std::vector<uint32_t>& fan{ vertexTriangles[indices[triangleIdx * 3 + cornerIdx]] };
+						fan.erase(std::find(fan.begin(), fan.end(), triangleIdx));
+					}
+				}
+
+				for (const auto& [vertexIdx, target] : vertexMoves)
+				{
+					for (uint32_t triangleIdx : vertexTriangles[vertexIdx])
+					{
+						uint32_t* pTriangle{ &indices[triangleIdx * 3] };
+						for (int cornerIdx = 0; cornerIdx < 3; ++cornerIdx)
+						{
+							pTriangle[cornerIdx] = pTriangle[cornerIdx] == vertexIdx ? target : pTriangle[cornerIdx];
+						}
+						vertexTriangles[target].push_back(triangleIdx);
+					}
+					vertexTriangles[vertexIdx].clear();
+				}
+				positionVertices[from].clear();
+
+				quadrics[to].Add(quadrics[from]);
+				largestError = std::max(largestError, error);
+
+				//The kept position has new neighbours, their collapses get fresh entries
+				gatherNeighbours(to, toNeighbours);
+				for (uint32_t neighbour : toNeighbours)
+				{
+					pushCollapse(to, neighbour);
+					pushCollapse(neighbour, to);
+				}
+			}
+
+			std::vector<uint32_t> simplifiedIndices{};
+			simplifiedIndices.reserve(nrLiveTriangles * 3);
+			for (uint32_t triangleIdx = 0; triangleIdx < nrTriangles; ++triangleIdx)
+			{
+				if (!isTriangleRemoved[triangleIdx])
+				{
+					simplifiedIndices.insert(simplifiedIndices.end(), indices.begin() + triangleIdx * 3, indices.begin() + triangleIdx * 3 + 3);
+				}
+			}
+			indices.swap(simplifiedIndices);
+
+			return float(std::sqrt(largestError));
+		}
+
+		//Drops the vertices no index refers to and renumbers the indices, the order of the remaining vertices is kept
+		static void RemoveUnusedVertices(std::vector<Vertex>& vertices, std::vector<uint32_t>& indices)
+		{
+			std::vector<uint32_t> remap(vertices.size(), UINT32_MAX);
+			for (uint32_t index : indices)
+			{
+				remap[index] = 0;
+			}
+
+			uint32_t nrUsedVertices{};
+			for (uint32_t vertexIdx = 0; vertexIdx < uint32_t(vertices.size()); ++vertexIdx)
+			{
+				if (remap[vertexIdx] == 0)
+				{
+					remap[vertexIdx] = nrUsedVertices;
+					vertices[nrUsedVertices++] = vertices[vertexIdx];
+				}
+			}
+			vertices.resize(nrUsedVertices);
+
+			for (uint32_t& index : indices)
+			{
+				index = remap[index];
+			}
+		}
+
+		//Tipsify (Sander et al. 2007): reorders a triangle list so consecutive triangles reuse the vertices of a FIFO cache of cacheSize entries
+		//Fans around one vertex at a time, the next fan vertex is the one that is still in the cache and has the fewest triangles left
+		static void OptimizeVertexCache(std::vector<uint32_t>& indices, uint32_t nrVertices, uint32_t cacheSize)
+		{
+			const uint32_t nrTriangles{ uint32_t(indices.size() / 3) };
+			if (nrTriangles == 0)
+			{
+				return;
+			}
+
+			//Triangles of every vertex, vertex v owns vertexTriangles[vertexOffsets[v]] up to vertexTriangles[vertexOffsets[v + 1]]
+			std::vector<uint32_t> liveTriangles(nrVertices);
+			for (uint32_t index : indices)
+			{
+				++liveTriangles[index];
+			}
+
+			std::vector<uint32_t> vertexOffsets(size_t(nrVertices) + 1);
+			for (uint32_t vertexIdx = 0; vertexIdx < nrVertices; ++vertexIdx)
+			{
+				vertexOffsets[vertexIdx + 1] = vertexOffsets[vertexIdx] + liveTriangles[vertexIdx];
+			}
+
+			std::vector<uint32_t> vertexTriangles(indices.size());
+			std::vector<uint32_t> fillOffsets{ vertexOffsets.begin(), vertexOffsets.end() - 1 };
+			for (uint32_t idx = 0; idx < uint32_t(indices.size()); ++idx)
+			{
+				vertexTriangles[fillOffsets[indices[idx]]++] = idx / 3;
+			}
+
+			std::vector<uint32_t> cacheTimes(nrVertices);
+			std::vector<bool> isEmitted(nrTriangles);
+			std::vector<uint32_t> deadEnds{};
+			std::vector<uint32_t> candidates{};
+			std::vector<uint32_t> optimizedIndices{};
+			optimizedIndices.reserve(indices.size());
+
+			uint32_t time{ cacheSize + 1 };
+			uint32_t cursor{};
+			int64_t fanVertex{ 0 };
+			while (fanVertex >= 0)
+			{
+				//Emit every remaining triangle around the fan vertex
+				candidates.clear();
+				for (uint32_t offset = vertexOffsets[fanVertex]; offset < vertexOffsets[fanVertex + 1]; ++offset)
+				{
+					const uint32_t triangleIdx{ vertexTriangles[offset] };
+					if (isEmitted[triangleIdx])
+					{
+						continue;
+					}
+
+					for (uint32_t cornerIdx = 0; cornerIdx < 3; ++cornerIdx)
+					{
+						const uint32_t index{ indices[triangleIdx * 3 + cornerIdx] };
+						optimizedIndices.push_back(index);
+						deadEnds.push_back(index);
+						candidates.push_back(index);
+						--liveTriangles[index];
+
+						if (time - cacheTimes[index] > cacheSize)
+						{
+							cacheTimes[index] = time++;
+						}
+					}
+					isEmitted[triangleIdx] = true;
+				}
+
+				//Prefer the oldest candidate that will still be in the cache after its remaining triangles are emitted
+				fanVertex = -1;
+				int64_t bestPriority{ -1 };
+				for (uint32_t candidate : candidates)
+				{
+					if (liveTriangles[candidate] == 0)
+					{
+						continue;
+					}
+
+					int64_t priority{ 0 };
+					if (int64_t(time) - cacheTimes[candidate] + 2 * int64_t(liveTriangles[candidate]) <= int64_t(cacheSize))
+					{
+						priority = int64_t(time) - cacheTimes[candidate];
+					}
+
+					if (priority > bestPriority)
+					{
+						bestPriority = priority;
+						fanVertex = candidate;
+					}
+				}
+
+				if (fanVertex >= 0)
+				{
+					continue;
+				}
+
+				//Dead end: go back to a recently used vertex, otherwise continue with the next vertex in input order
+				while (!deadEnds.empty() && fanVertex < 0)
+				{
+					const uint32_t vertexIdx{ deadEnds.back() };
+					deadEnds.pop_back();
+					if (liveTriangles[vertexIdx] > 0)
+					{
+						fanVertex = vertexIdx;
+					}
+				}
+
+				for (; cursor < nrVertices && fanVertex < 0; ++cursor)
+				{
+					if (liveTriangles[cursor] > 0)
+					{
+						fanVertex = cursor;
+					}
+				}
+			}
+
+			indices.swap(optimizedIndices);
+		}
+
+		//Average cache miss ratio: vertex transforms per triangle of a triangle list going through a FIFO cache of cacheSize entries
+		static float GetACMR(const std::vector<uint32_t>& indices, uint32_t cacheSize)
+		{
+			std::vector<uint32_t> cache(cacheSize, UINT32_MAX);
+			uint32_t nextSlot{};
+			uint32_t nrMisses{};
+			for (uint32_t index : indices)
+			{
+				if (std::find(cache.begin(), cache.end(), index) != cache.end())
+				{
+					continue;
+				}
+
+				cache[nextSlot] = index;
+				nextSlot = (nextSlot + 1) % cacheSize;
+				++nrMisses;
+			}
+
+			return indices.empty() ? 0.f : float(nrMisses) / (indices.size() / 3);
+		}
+
+		//Greedy stripifier: a strip starts at the first unused triangle and keeps walking over shared edges
+		//Odd triangles of a strip have their winding flipped, strips are joined with degenerate triangles
+		static void StripifyTriangleList(const std::vector<uint32_t>& listIndices, std::vector<uint32_t>& stripIndices)
+		{
+			const uint32_t nrTriangles{ uint32_t(listIndices.size() / 3) };
+			stripIndices.clear();
+
+			//Every edge of every triangle, sorted so the triangles sharing an edge are next to each other
+			const auto getEdgeKey{ [](uint32_t index0, uint32_t index1)
+				{
+					return (uint64_t(std::min(index0, index1)) << 32) | std::max(index0, index1);
+				} };
+
+			std::vector<std::pair<uint64_t, uint32_t>> edges{};
+			edges.reserve(listIndices.size());
+			for (uint32_t triangleIdx = 0; triangleIdx < nrTriangles; ++triangleIdx)
+			{
+				for (uint32_t cornerIdx = 0; cornerIdx < 3; ++cornerIdx)
+				{
+					edges.emplace_back(getEdgeKey(listIndices[triangleIdx * 3 + cornerIdx], listIndices[triangleIdx * 3 + (cornerIdx + 1) % 3]), triangleIdx);
+				}
+			}
+			std::sort(edges.begin(), edges.end());
+
+			std::vector<bool> isUsed(nrTriangles);
+			std::vector<uint32_t> strip{};
+			std::vector<uint32_t> stripTriangles{};
+			std::vector<uint32_t> bestStrip{};
+			std::vector<uint32_t> bestStripTriangles{};
+
+			//Extends the strip as long as an unused triangle continues it with the right winding
+			const auto growStrip{ [&](uint32_t triangleIdx, uint32_t rotation)
+				{
+					strip.clear();
+					stripTriangles.clear();
+					for (uint32_t cornerIdx = 0; cornerIdx < 3; ++cornerIdx)
+					{
+						strip.push_back(listIndices[triangleIdx * 3 + (rotation + cornerIdx) % 3]);
+					}
+					stripTriangles.push_back(triangleIdx);
+					isUsed[triangleIdx] = true;
+
+					while (true)
+					{
+						//Triangle k of the strip is (s[k], s[k+1], s[k+2]) when k is even and (s[k], s[k+2], s[k+1]) when it is odd
+						//Either way the next triangle has to contain the directed edge from -> to, followed by the new index
+						const bool isOdd{ (strip.size() - 2) % 2 == 1 };
+						const uint32_t from{ isOdd ? strip[strip.size() - 1] : strip[strip.size() - 2] };
+						const uint32_t to{ isOdd ? strip[strip.size() - 2] : strip[strip.size() - 1] };
+
+						uint32_t nextTriangleIdx{ UINT32_MAX };
+						uint32_t nextIndex{};
+						const uint64_t edgeKey{ getEdgeKey(from, to) };
+						for (auto it{ std::lower_bound(edges.begin(), edges.end(), std::make_pair(edgeKey, uint32_t(0))) }; it != edges.end() && it->first == edgeKey; ++it)
+						{
+							if (isUsed[it->second])
+							{
+								continue;
+							}
+
+							const uint32_t* pCorners{ &listIndices[size_t(it->second) * 3] };
+							for (uint32_t cornerIdx = 0; cornerIdx < 3; ++cornerIdx)
+							{
+								if (pCorners[cornerIdx] == from && pCorners[(cornerIdx + 1) % 3] == to)
+								{
+									nextTriangleIdx = it->second;
+									nextIndex = pCorners[(cornerIdx + 2) % 3];
+								}
+							}
+
+							if (nextTriangleIdx != UINT32_MAX)
+							{
+								break;
+							}
+						}
+
+						if (nextTriangleIdx == UINT32_MAX)
+						{
+							break;
+						}
+
+						strip.push_back(nextIndex);
+						stripTriangles.push_back(nextTriangleIdx);
+						isUsed[nextTriangleIdx] = true;
+					}
+				} };
+
+			for (uint32_t triangleIdx = 0; triangleIdx < nrTriangles; ++triangleIdx)
+			{
+				if (isUsed[triangleIdx])
+				{
+					continue;
+				}
+
+				//Every rotation of the first triangle leaves over a different edge, keep the longest strip
+				bestStrip.clear();
+				bestStripTriangles.clear();
+				for (uint32_t rotation = 0; rotation < 3; ++rotation)
+				{
+					growStrip(triangleIdx, rotation);
+					for (uint32_t stripTriangleIdx : stripTriangles)
+					{
+						isUsed[stripTriangleIdx] = false;
+					}
+
+					if (strip.size() > bestStrip.size())
+					{
+						bestStrip.swap(strip);
+						bestStripTriangles.swap(stripTriangles);
+					}
+				}
+
+				for (uint32_t stripTriangleIdx : bestStripTriangles)
+				{
+					isUsed[stripTriangleIdx] = true;
+				}
+
+				//Repeating the last index and the next first index only creates degenerate triangles
+				//The next strip has to start at an even position so its winding isn't flipped
+				if (!stripIndices.empty())
+				{
+					stripIndices.push_back(stripIndices.back());
+					stripIndices.push_back(bestStrip.front());
+					if (stripIndices.size() % 2 == 1)
+					{
+						stripIndices.push_back(bestStrip.front());
+					}
+				}
+				stripIndices.insert(stripIndices.end(), bestStrip.begin(), bestStrip.end());
+			}
+		}
+
+		//Checks both the CPU and the OS (saved YMM state) before any AVX2 code path is taken
+		static bool IsAVX2Supported()
+		{
+			int cpuInfo[4]{};
+
+#ifdef _MSC_VER
+			__cpuid(cpuInfo, 1);
+#else
+			__cpuid(1, cpuInfo[0], cpuInfo[1], cpuInfo[2], cpuInfo[3]);
+#endif
+			const bool isOSXSaveSupported{ (cpuInfo[2] & (1 << 27)) != 0 };
+			const bool isAVXSupported{ (cpuInfo[2] & (1 << 28)) != 0 };
+			if (!isOSXSaveSupported || !isAVXSupported)
+				return false;
+
+#ifdef _MSC_VER
+			const unsigned long long enabledStates{ _xgetbv(0) };
+#else
+			unsigned int xcrLow{}, xcrHigh{};
+			__asm__("xgetbv" : "=a"(xcrLow), "=d"(xcrHigh) : "c"(0));
+			const unsigned long long enabledStates{ (static_cast<unsigned long long>(xcrHigh) << 32) | xcrLow };
+#endif
+			//XMM and YMM registers have to be saved by the OS
+			if ((enabledStates & 0x6) != 0x6)
+				return false;
+
+#ifdef _MSC_VER
+			__cpuidex(cpuInfo, 7, 0);
+#else
+			__cpuid_count(7, 0, cpuInfo[0], cpuInfo[1], cpuInfo[2], cpuInfo[3]);
+#endif
+			return (cpuInfo[1] & (1 << 5)) != 0;
+		}
 #pragma warning(pop)
 	}
 }
\ No newline at end of file
@@ -64,6 +64,24 @@ int main(int argc, char* args[])
 
 				if (e.key.keysym.scancode == SDL_SCANCODE_X)
 					takeScreenshot = true;
+				if (e.key.keysym.scancode == SDL_SCANCODE_F1)
+					pRenderer->ToggleVisibilityBuffer();
+				if (e.key.keysym.scancode == SDL_SCANCODE_F2)
+					pRenderer->ToggleDepthPrePass();
+				if (e.key.keysym.scancode == SDL_SCANCODE_F3)
+					pRenderer->CycleCullMode();
+				if (e.key.keysym.scancode == SDL_SCANCODE_F4)
+					pRenderer->CycleDepthFormat();
+				if (e.key.keysym.scancode == SDL_SCANCODE_F5)
+					pRenderer->ToggleDepthSorting();
+				if (e.key.keysym.scancode == SDL_SCANCODE_F6)
+					pRenderer->ToggleOnDemandTransform();
+				if (e.key.keysym.scancode == SDL_SCANCODE_F7)
+					pRenderer->ToggleInstancing();
+				if (e.key.keysym.scancode == SDL_SCANCODE_F8)
+					pRenderer->ToggleLOD();
+				if (e.key.keysym.scancode == SDL_SCANCODE_F9)
+					pRenderer->CycleLODHysteresis();
 				break;
 			}
 		}
@@ -81,6 +99,7 @@ int main(int argc, char* args[])
 		{
 			printTimer = 0.f;
 			std::cout << "dFPS: " << pTimer->GetdFPS() << std::endl;
+			pRenderer->PrintStatistics();
 		}
 
 		//Save screenshot after full render